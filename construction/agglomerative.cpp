@@ -0,0 +1,115 @@
+#include "agglomerative.hpp"
+
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <tuple>
+
+namespace {
+    struct Candidate {
+        float distance;
+        int32_t a;
+        int32_t b;
+
+        // 距离相同时按下标比较, 保证合并顺序确定
+        bool operator>(const Candidate& other) const
+        {
+            return std::tie(distance, a, b) > std::tie(other.distance, other.a, other.b);
+        }
+    };
+
+    float mergedArea(const BoundingBox& a, const BoundingBox& b)
+    {
+        BoundingBox merged = a;
+        merged.expand(b);
+        return merged.surface_area();
+    }
+} // namespace
+
+std::vector<AgglomerativeNode> agglomerate(const std::vector<BoundingBox>& boxes, const std::vector<uint32_t>& counts)
+{
+    const size_t n = boxes.size();
+    std::vector<AgglomerativeNode> nodes;
+    if (n == 0) {
+        return nodes;
+    }
+    nodes.reserve(2 * n - 1);
+    for (size_t i = 0; i < n; ++i) {
+        AgglomerativeNode leaf;
+        leaf.bb = boxes[i];
+        leaf.count = counts[i];
+        nodes.push_back(leaf);
+    }
+
+    // 仍未被合并的簇, position用于O(1)删除
+    std::vector<int32_t> active(n);
+    std::vector<int32_t> position(2 * n - 1, -1);
+    for (size_t i = 0; i < n; ++i) {
+        active[i] = static_cast<int32_t>(i);
+        position[i] = static_cast<int32_t>(i);
+    }
+    auto deactivate = [&](int32_t id) {
+        int32_t last = active.back();
+        active[position[id]] = last;
+        position[last] = position[id];
+        active.pop_back();
+        position[id] = -1;
+    };
+
+    // 距离为inf/NaN (退化或溢出的包围盒) 时按inf处理, 且总会选中一个b, 保证best.b有效
+    auto nearest = [&](int32_t a) {
+        Candidate best { std::numeric_limits<float>::infinity(), a, -1 };
+        for (int32_t b : active) {
+            if (b == a)
+                continue;
+            float distance = mergedArea(nodes[a].bb, nodes[b].bb);
+            if (std::isnan(distance))
+                distance = std::numeric_limits<float>::infinity();
+            if (best.b < 0 || distance < best.distance || (distance == best.distance && b < best.b)) {
+                best.distance = distance;
+                best.b = b;
+            }
+        }
+        return best;
+    };
+
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> heap;
+    if (n > 1) {
+        for (int32_t a : active) {
+            heap.push(nearest(a));
+        }
+    }
+
+    while (active.size() > 1) {
+        Candidate candidate = heap.top();
+        heap.pop();
+        // a已被合并: 丢弃
+        if (position[candidate.a] < 0)
+            continue;
+        // a的最近邻已被合并: 重新查找
+        if (position[candidate.b] < 0) {
+            heap.push(nearest(candidate.a));
+            continue;
+        }
+
+        AgglomerativeNode merged;
+        merged.bb = nodes[candidate.a].bb;
+        merged.bb.expand(nodes[candidate.b].bb);
+        merged.left = candidate.a;
+        merged.right = candidate.b;
+        merged.count = nodes[candidate.a].count + nodes[candidate.b].count;
+
+        const int32_t id = static_cast<int32_t>(nodes.size());
+        nodes.push_back(merged);
+        deactivate(candidate.a);
+        deactivate(candidate.b);
+        position[id] = static_cast<int32_t>(active.size());
+        active.push_back(id);
+
+        if (active.size() > 1) {
+            heap.push(nearest(id));
+        }
+    }
+    return nodes;
+}
@@ -0,0 +1,28 @@
+#ifndef AGGLOMERATIVE_H_
+#define AGGLOMERATIVE_H_
+
+#include "bbox.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// 凝聚聚类得到的二叉树节点
+// 内部节点只保存子节点下标、合并后的包围盒和图元数, 不保存图元下标
+struct AgglomerativeNode {
+    BoundingBox bb;
+    // 叶子节点为-1
+    int32_t left = -1;
+    int32_t right = -1;
+    uint32_t count = 0;
+
+    inline bool isLeaf() const { return left < 0; }
+};
+
+// Fast Agglomerative Clustering for Rendering
+// https://www.graphics.cornell.edu/~bjw/IRT08Agglomerative.pdf
+// 每次合并表面积 (合并后的包围盒) 最小的一对, 用堆缓存每个簇的最近邻,
+// 最近邻被合并后才惰性地重新查找; 合并后的包围盒直接由两个子节点的包围盒求并
+// 返回的数组中前n个为叶子 (与输入同序), 之后为内部节点, 根节点为最后一个
+std::vector<AgglomerativeNode> agglomerate(const std::vector<BoundingBox>& boxes, const std::vector<uint32_t>& counts);
+
+#endif // AGGLOMERATIVE_H_
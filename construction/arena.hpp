@@ -0,0 +1,172 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <omp.h>
+
+// 单次构造使用的单调分配器: 只分配不回收, 析构 (或release) 时一次性释放
+// 每个OpenMP线程有自己的chunk链表, 并行构造子树时分配不需要加锁
+// 非平凡析构的对象登记析构函数, 释放前按分配的逆序调用
+class Arena {
+public:
+    explicit Arena(size_t chunk_size = 64 * 1024)
+        : m_chunkSize(chunk_size)
+        , m_slots(std::max(omp_get_max_threads(), 1) + 1)
+    {
+    }
+
+    ~Arena() { release(); }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // 未初始化的内存
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t))
+    {
+        Slot& slot = current();
+        if (&slot != &m_slots.back())
+            return slot.allocate(bytes, alignment, m_chunkSize);
+        // 嵌套并行区域中的线程, 或线程号超出预留范围时, 共用最后一个加锁的slot
+        std::lock_guard<std::mutex> lock(m_overflowMutex);
+        return slot.allocate(bytes, alignment, m_chunkSize);
+    }
+
+    template <typename T>
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+    }
+
+    template <typename T, typename... Args>
+    T* create(Args&&... args)
+    {
+        T* object = new (allocate<T>(1)) T(std::forward<Args>(args)...);
+        track(object, 1);
+        return object;
+    }
+
+    // 值初始化的数组 (指针等标量为0)
+    template <typename T>
+    T* create_array(size_t n)
+    {
+        T* array = allocate<T>(n);
+        for (size_t i = 0; i < n; ++i)
+            new (array + i) T();
+        track(array, n);
+        return array;
+    }
+
+    // 调用登记的析构函数并释放所有chunk
+    void release()
+    {
+        for (Slot& slot : m_slots)
+            slot.release();
+    }
+
+    // 已分配出去的字节数与向系统申请的字节数 (峰值, 单调分配器只增不减)
+    size_t bytes_used() const
+    {
+        size_t total = 0;
+        for (const Slot& slot : m_slots)
+            total += slot.used;
+        return total;
+    }
+
+    size_t bytes_reserved() const
+    {
+        size_t total = 0;
+        for (const Slot& slot : m_slots)
+            total += slot.reserved;
+        return total;
+    }
+
+private:
+    struct Finalizer {
+        void (*destroy)(void* p, size_t n);
+        void* p;
+        size_t n;
+    };
+
+    // 对齐到cache line, 避免不同线程的游标伪共享
+    struct alignas(64) Slot {
+        std::vector<std::unique_ptr<unsigned char[]>> chunks;
+        std::vector<Finalizer> finalizers;
+        unsigned char* cursor = nullptr;
+        size_t remaining = 0;
+        size_t used = 0;
+        size_t reserved = 0;
+
+        void* allocate(size_t bytes, size_t alignment, size_t chunk_size)
+        {
+            size_t padding = (alignment - reinterpret_cast<uintptr_t>(cursor) % alignment) % alignment;
+            if (cursor == nullptr || padding + bytes > remaining) {
+                // 超过chunk大小的请求单独占一个chunk
+                const size_t size = std::max(chunk_size, bytes + alignment);
+                chunks.emplace_back(new unsigned char[size]);
+                cursor = chunks.back().get();
+                remaining = size;
+                reserved += size;
+                padding = (alignment - reinterpret_cast<uintptr_t>(cursor) % alignment) % alignment;
+            }
+            void* p = cursor + padding;
+            cursor += padding + bytes;
+            remaining -= padding + bytes;
+            used += bytes;
+            return p;
+        }
+
+        void release()
+        {
+            for (size_t i = finalizers.size(); i-- > 0;)
+                finalizers[i].destroy(finalizers[i].p, finalizers[i].n);
+            finalizers.clear();
+            chunks.clear();
+            cursor = nullptr;
+            remaining = 0;
+        }
+    };
+
+    // 线程号只在最外层的线程组内唯一: 嵌套的线程组从0重新编号, 会与外层线程共用slot
+    // 因此只有层级不超过1时按线程号选slot, 更深的层级一律使用加锁的overflow slot
+    Slot& current()
+    {
+        if (omp_get_level() > 1)
+            return m_slots.back();
+        const size_t thread = static_cast<size_t>(omp_get_thread_num());
+        return m_slots[std::min(thread, m_slots.size() - 1)];
+    }
+
+    template <typename T>
+    void track(T* p, size_t n)
+    {
+        if (std::is_trivially_destructible<T>::value)
+            return;
+        Finalizer finalizer = { [](void* q, size_t count) {
+                                   T* array = static_cast<T*>(q);
+                                   for (size_t i = count; i-- > 0;)
+                                       array[i].~T();
+                               },
+            p, n };
+        Slot& slot = current();
+        if (&slot != &m_slots.back()) {
+            slot.finalizers.push_back(finalizer);
+        } else {
+            std::lock_guard<std::mutex> lock(m_overflowMutex);
+            slot.finalizers.push_back(finalizer);
+        }
+    }
+
+    size_t m_chunkSize;
+    std::vector<Slot> m_slots;
+    std::mutex m_overflowMutex;
+};
+
+#endif // ARENA_H_
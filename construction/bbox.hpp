@@ -105,7 +105,7 @@ public:
         uint8_t d = 0;
         if (extent.y > extent.x)
             d = 1;
-        if (extent.z > extent.y)
+        if (extent.z > extent[d])
             d = 2;
         return d;
     }
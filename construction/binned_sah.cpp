@@ -0,0 +1,271 @@
+#include "binned_sah.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+// 未指定--max_leaf时叶子的图元数上限
+#define defaultMaxLeaf 8
+// 小于该图元数的子树不再单独生成task
+#define minTaskSize 1024
+// 图元数不少于该值的节点分块并行分箱
+#define parallelBinSize 16384
+// 并行分箱时每块的图元数
+#define binBlockSize 4096
+
+namespace {
+    inline float centroid(const aligned_vector<float>& lo, const aligned_vector<float>& hi, size_t slot)
+    {
+        return 0.5f * (lo[slot] + hi[slot]);
+    }
+
+    // 分箱与划分必须用同一个表达式, 保证同一个图元总是落在同一个箱子里
+    inline size_t bin_index(float c, float lo, float scale, size_t bins)
+    {
+        const long b = static_cast<long>((c - lo) * scale);
+        return static_cast<size_t>(std::min<long>(std::max<long>(b, 0), static_cast<long>(bins) - 1));
+    }
+
+    inline float half_area(const float* lo, const float* hi)
+    {
+        const float dx = hi[0] - lo[0], dy = hi[1] - lo[1], dz = hi[2] - lo[2];
+        return dx * dy + dy * dz + dz * dx;
+    }
+} // namespace
+
+void BinnedSAH::Bin::clear()
+{
+    for (int a = 0; a < 3; ++a) {
+        bmin[a] = cmin[a] = INF_F;
+        bmax[a] = cmax[a] = -INF_F;
+    }
+    count = 0;
+}
+
+void BinnedSAH::Bin::merge(const Bin& other)
+{
+    for (int a = 0; a < 3; ++a) {
+        bmin[a] = std::min(bmin[a], other.bmin[a]);
+        bmax[a] = std::max(bmax[a], other.bmax[a]);
+        cmin[a] = std::min(cmin[a], other.cmin[a]);
+        cmax[a] = std::max(cmax[a], other.cmax[a]);
+    }
+    count += other.count;
+}
+
+BinnedSAH::BinnedSAH(size_t bins, float traversal, float intersection, size_t max_leaf, bool task_parallel, LinearBVH::Layout layout)
+    : m_bins(std::max<size_t>(bins, 2))
+    , m_traversal(traversal)
+    , m_intersection(intersection)
+    , m_maxLeaf(max_leaf > 0 ? max_leaf : defaultMaxLeaf)
+    , m_taskParallel(task_parallel)
+    , m_layout(layout)
+{
+}
+
+void BinnedSAH::binRange(size_t begin, size_t end, const Bin& node, size_t B, Bin* bins) const
+{
+    const PrimitiveBounds& store = *m_store;
+    float scale[3];
+    for (int a = 0; a < 3; ++a) {
+        const float extent = node.cmax[a] - node.cmin[a];
+        scale[a] = extent > 0.0f ? B / extent : 0.0f;
+    }
+    const aligned_vector<float>* lo[3] = { &store.minX, &store.minY, &store.minZ };
+    const aligned_vector<float>* hi[3] = { &store.maxX, &store.maxY, &store.maxZ };
+
+    for (size_t i = 0; i < 3 * B; ++i)
+        bins[i].clear();
+    for (size_t slot = begin; slot < end; ++slot) {
+        const float bmin[3] = { store.minX[slot], store.minY[slot], store.minZ[slot] };
+        const float bmax[3] = { store.maxX[slot], store.maxY[slot], store.maxZ[slot] };
+        float c[3];
+        for (int a = 0; a < 3; ++a)
+            c[a] = centroid(*lo[a], *hi[a], slot);
+        for (int a = 0; a < 3; ++a) {
+            Bin& bin = bins[a * B + bin_index(c[a], node.cmin[a], scale[a], B)];
+            for (int d = 0; d < 3; ++d) {
+                bin.bmin[d] = std::min(bin.bmin[d], bmin[d]);
+                bin.bmax[d] = std::max(bin.bmax[d], bmax[d]);
+                bin.cmin[d] = std::min(bin.cmin[d], c[d]);
+                bin.cmax[d] = std::max(bin.cmax[d], c[d]);
+            }
+            ++bin.count;
+        }
+    }
+}
+
+KBVHNode* BinnedSAH::makeNode(const Bin& box)
+{
+    return m_arena->create<KBVHNode>(BoundingBox(glm::vec3(box.bmin[0], box.bmin[1], box.bmin[2]),
+                                                 glm::vec3(box.bmax[0], box.bmax[1], box.bmax[2])),
+                                     box.count);
+}
+
+KBVHNode* BinnedSAH::split(size_t begin, size_t end, const Bin& node)
+{
+    PrimitiveBounds& store = *m_store;
+    const size_t n = end - begin;
+    KBVHNode* result = makeNode(node);
+
+    // 在三个轴的箱子边界上找SAH代价最小的划分, 代价相对于本节点的面积
+    // 图元数少于箱子数时箱子数取图元数, 小节点不必扫描大量空箱子
+    const size_t B = std::min(m_bins, std::max<size_t>(n, 2));
+    std::vector<Bin> bins;
+    int best_axis = -1;
+    size_t best_split = 0;
+    float best_cost = INF_F;
+    const float area = half_area(node.bmin, node.bmax);
+    if (n > 1) {
+        bins.resize(3 * B);
+        if (n >= parallelBinSize) {
+            // 每块分入自己的箱子, 再按块的顺序合并
+            const size_t blocks = (n + binBlockSize - 1) / binBlockSize;
+            std::vector<Bin> partial(blocks * 3 * B);
+            // 任务模式下已在并行区域内, 用taskloop; 否则为分箱单独开一个parallel for
+            if (m_taskParallel) {
+                #pragma omp taskloop grainsize(1) default(shared)
+                for (size_t b = 0; b < blocks; ++b)
+                    binRange(begin + b * binBlockSize, std::min(end, begin + (b + 1) * binBlockSize), node, B, &partial[b * 3 * B]);
+            } else {
+                #pragma omp parallel for schedule(static)
+                for (size_t b = 0; b < blocks; ++b)
+                    binRange(begin + b * binBlockSize, std::min(end, begin + (b + 1) * binBlockSize), node, B, &partial[b * 3 * B]);
+            }
+            for (size_t i = 0; i < 3 * B; ++i)
+                bins[i].clear();
+            for (size_t b = 0; b < blocks; ++b)
+                for (size_t i = 0; i < 3 * B; ++i)
+                    bins[i].merge(partial[b * 3 * B + i]);
+        } else {
+            binRange(begin, end, node, B, bins.data());
+        }
+
+        std::vector<float> right_area(B);
+        std::vector<uint32_t> right_count(B);
+        for (int a = 0; a < 3; ++a) {
+            if (!(node.cmax[a] > node.cmin[a]))
+                continue;
+            const Bin* axis_bins = &bins[a * B];
+            // right_*[i]: 箱子[i, B)的并
+            Bin acc;
+            acc.clear();
+            for (size_t i = B; i-- > 1;) {
+                acc.merge(axis_bins[i]);
+                right_area[i] = acc.count > 0 ? half_area(acc.bmin, acc.bmax) : 0.0f;
+                right_count[i] = acc.count;
+            }
+            acc.clear();
+            for (size_t i = 1; i < B; ++i) {
+                acc.merge(axis_bins[i - 1]);
+                if (acc.count == 0 || right_count[i] == 0)
+                    continue;
+                const float cost = acc.count * half_area(acc.bmin, acc.bmax) + right_count[i] * right_area[i];
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = a;
+                    best_split = i;
+                }
+            }
+        }
+        if (best_axis >= 0)
+            best_cost = m_traversal + m_intersection * (area > 0.0f ? best_cost / area : 0.0f);
+    }
+
+    // 划分不比作为叶子更便宜 (或无法按中心划分) 时成为叶子, 但图元数超过上限的节点总是继续划分
+    bool leaf = n <= 1;
+    if (!leaf && n <= m_maxLeaf)
+        leaf = best_axis < 0 || area <= 0.0f || m_intersection * n <= best_cost;
+    if (leaf) {
+        result->begin = begin;
+        result->end = end;
+        return result;
+    }
+
+    Bin left, right;
+    left.clear();
+    right.clear();
+    size_t mid;
+    if (best_axis >= 0) {
+        const float extent = node.cmax[best_axis] - node.cmin[best_axis];
+        const float scale = B / extent;
+        const aligned_vector<float>& lo = best_axis == 0 ? store.minX : best_axis == 1 ? store.minY : store.minZ;
+        const aligned_vector<float>& hi = best_axis == 0 ? store.maxX : best_axis == 1 ? store.maxY : store.maxZ;
+        size_t i = begin, j = end;
+        while (i < j) {
+            if (bin_index(centroid(lo, hi, i), node.cmin[best_axis], scale, B) < best_split)
+                ++i;
+            else
+                store.swap(i, --j);
+        }
+        mid = i;
+        for (size_t b = 0; b < B; ++b)
+            (b < best_split ? left : right).merge(bins[best_axis * B + b]);
+    } else {
+        // 所有图元的中心重合, 按槽位对半划分
+        #pragma omp atomic
+        ++m_medianSplits;
+        mid = begin + n / 2;
+        for (size_t slot = begin; slot < end; ++slot) {
+            Bin& side = slot < mid ? left : right;
+            const float bmin[3] = { store.minX[slot], store.minY[slot], store.minZ[slot] };
+            const float bmax[3] = { store.maxX[slot], store.maxY[slot], store.maxZ[slot] };
+            for (int d = 0; d < 3; ++d) {
+                side.bmin[d] = std::min(side.bmin[d], bmin[d]);
+                side.bmax[d] = std::max(side.bmax[d], bmax[d]);
+                side.cmin[d] = std::min(side.cmin[d], 0.5f * (bmin[d] + bmax[d]));
+                side.cmax[d] = std::max(side.cmax[d], 0.5f * (bmin[d] + bmax[d]));
+            }
+            ++side.count;
+        }
+    }
+
+    KBVHNode* l = NULL;
+    #pragma omp task shared(l) if(mid - begin >= minTaskSize)
+    l = split(begin, mid, left);
+    KBVHNode* r = split(mid, end, right);
+    #pragma omp taskwait
+    result->l = l;
+    result->r = r;
+    return result;
+}
+
+void BinnedSAH::build(const TriangleMesh& mesh, PrimitiveBounds& bounds, Arena& arena, LinearBVH& bvh)
+{
+    (void)mesh;
+    m_store = &bounds;
+    m_arena = &arena;
+    m_medianSplits = 0;
+    bvh.nodes.clear();
+    if (bounds.size() == 0)
+        return;
+
+    Bin root;
+    root.clear();
+    for (size_t slot = 0; slot < bounds.size(); ++slot) {
+        const float bmin[3] = { bounds.minX[slot], bounds.minY[slot], bounds.minZ[slot] };
+        const float bmax[3] = { bounds.maxX[slot], bounds.maxY[slot], bounds.maxZ[slot] };
+        for (int d = 0; d < 3; ++d) {
+            root.bmin[d] = std::min(root.bmin[d], bmin[d]);
+            root.bmax[d] = std::max(root.bmax[d], bmax[d]);
+            root.cmin[d] = std::min(root.cmin[d], 0.5f * (bmin[d] + bmax[d]));
+            root.cmax[d] = std::max(root.cmax[d], 0.5f * (bmin[d] + bmax[d]));
+        }
+        ++root.count;
+    }
+
+    std::cout << "[Log] Binned SAH BVH Building... (" << m_bins << " bins, max leaf " << m_maxLeaf << ")" << std::endl;
+    KBVHNode* tree = NULL;
+    if (m_taskParallel) {
+        #pragma omp parallel
+        #pragma omp single
+        tree = split(0, bounds.size(), root);
+    } else {
+        tree = split(0, bounds.size(), root);
+    }
+    if (m_medianSplits > 0) {
+        std::cout << "[Log] Median split fallback: " << m_medianSplits << " nodes" << std::endl;
+    }
+
+    bvh.flatten(tree, m_layout);
+}
@@ -0,0 +1,49 @@
+#ifndef BINNED_SAH_H_
+#define BINNED_SAH_H_
+
+#include "build_engine.hpp"
+#include "kmeans.hpp"
+
+#include <cstddef>
+
+// 自顶向下的分箱SAH构造 (二叉树), 作为k-means构造的对照
+// 每个节点在图元中心的包围盒内把三个轴各等分为bins个箱子, 扫描箱子边界求SAH代价最小的划分;
+// 大节点分块并行分箱, 两侧子树以OpenMP task并行构造
+class BinnedSAH : public BuildEngine {
+public:
+    // max_leaf为0时使用默认的叶子图元数上限
+    BinnedSAH(size_t bins, float traversal, float intersection, size_t max_leaf, bool task_parallel, LinearBVH::Layout layout);
+
+    const char* name() const override { return "Binned SAH"; }
+
+    void build(const TriangleMesh& mesh, PrimitiveBounds& bounds, Arena& arena, LinearBVH& bvh) override;
+
+private:
+    // 一个箱子: 图元包围盒与图元中心的包围盒, 以及图元数
+    struct Bin {
+        float bmin[3], bmax[3];
+        float cmin[3], cmax[3];
+        uint32_t count;
+
+        void clear();
+        void merge(const Bin& other);
+    };
+
+    KBVHNode* split(size_t begin, size_t end, const Bin& node);
+    // 把[begin, end)的图元按中心分入每个轴B个箱子 (bins[axis * B + b])
+    void binRange(size_t begin, size_t end, const Bin& node, size_t B, Bin* bins) const;
+    KBVHNode* makeNode(const Bin& box);
+
+    size_t m_bins;
+    float m_traversal;
+    float m_intersection;
+    size_t m_maxLeaf;
+    bool m_taskParallel;
+    LinearBVH::Layout m_layout;
+
+    PrimitiveBounds* m_store = nullptr;
+    Arena* m_arena = nullptr;
+    size_t m_medianSplits = 0;
+};
+
+#endif // BINNED_SAH_H_
@@ -0,0 +1,32 @@
+#ifndef BUILD_ENGINE_H_
+#define BUILD_ENGINE_H_
+
+#include "arena.hpp"
+#include "linear_bvh.hpp"
+#include "primitive_bounds.hpp"
+#include "triangle_mesh.hpp"
+
+#include <vector>
+
+// BVHBuilder::Build() 使用的构造策略 (--builder 选择)
+// 所有engine在同一份PrimitiveBounds上构造, 输出同样的线性节点数组, 以便比较构造时间与SAH代价
+class BuildEngine {
+public:
+    virtual ~BuildEngine() {}
+
+    virtual const char* name() const = 0;
+
+    // 构造前的准备 (指令集选择, kernel测量, 参照构造等), 不计入构造时间
+    // 结束时bounds必须是build()的初始状态
+    virtual void prepare(const TriangleMesh& mesh, PrimitiveBounds& bounds)
+    {
+        (void)mesh;
+        (void)bounds;
+    }
+
+    // 在bounds的全部槽位上构造, 可以在槽位区间内重排bounds; 构造用的节点分配在arena中
+    // 结果写入bvh.nodes, 叶子的offset为bounds中的槽位 (三角形由调用方按槽位重排)
+    virtual void build(const TriangleMesh& mesh, PrimitiveBounds& bounds, Arena& arena, LinearBVH& bvh) = 0;
+};
+
+#endif // BUILD_ENGINE_H_
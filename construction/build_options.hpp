@@ -0,0 +1,216 @@
+#ifndef BUILD_OPTIONS_H_
+#define BUILD_OPTIONS_H_
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// 构造参数, 由命令行设置 (见 main.cpp), BVHBuilder::Build() 读取
+struct BuildOptions {
+    // 构造方式: kmeans (默认) / binned (分箱SAH) / lbvh (Morton码线性BVH) / ploc (局部有序聚类)
+    // all: 依次运行所有engine并列出构造时间与SAH代价
+    std::string builder;
+    // 分箱SAH每个轴的箱子数
+    size_t bins = 32;
+    // LBVH与PLOC的Morton码位数: 30 (每轴10位) 或 63 (每轴21位)
+    int morton_bits = 30;
+    // PLOC最近邻搜索的窗口半径 (前后各radius个cluster)
+    size_t ploc_radius = 16;
+
+    // 读取OBJ时使用其旁边的二进制缓存 (<obj路径>.meshcache), 不存在或已过期时解析OBJ并写入
+    bool mesh_cache = true;
+    // 读取OBJ时保存每个三角形角的法线与纹理坐标 (可选的属性流, 构造不使用)
+    bool attributes = false;
+
+    // 兄弟cluster的子树以OpenMP task并行构造 (空闲线程窃取任务)
+    bool task_parallel = false;
+    // 先以原始串行递归构造一遍作为参照, 报告加速比
+    bool compare = false;
+    // 聚类数 (k叉树的分支数), 2/4/8/16 有编译期特化的kernel
+    size_t k = 8;
+    // 限制最近centroid kernel的指令集 (scalar/avx2/avx512), 为空时按CPU自动选择
+    std::string isa;
+    // 构造前测量各指令集kernel的吞吐量
+    bool bench_kernel = false;
+    // 随机种子: 相同的种子和参数总是构造出相同的树, 与线程数无关
+    uint64_t seed = 0;
+    // 每个节点的k-means迭代次数上限, 0表示默认值 (未设置converge时为2, 否则为16)
+    size_t iterations = 0;
+    // 改变cluster的图元比例低于该值时提前结束迭代, 0表示只在完全收敛时提前结束
+    float converge = 0.0f;
+
+    // 图元数超过该值的节点只在采样上迭代求质心, 再做一次全量分配, 0表示关闭
+    size_t sample_threshold = 0;
+    // 采样大小: 不大于1时为比例, 否则为个数
+    double sample_size = 65536;
+
+    // 初始centroid的选取方式: heuristic (默认) / kmeans++ / kmeans||
+    std::string seeding;
+
+    // 按SAH代价决定叶子 (代替图元数少于4K即为叶子), 遍历与求交的相对代价, 叶子图元数上限 (不带--sah_leaf时同样有效; 0: k-means为4K, 分箱SAH为8, LBVH与PLOC为4)
+    bool sah_leaf = false;
+    float traversal_cost = 1.0f;
+    float intersection_cost = 1.0f;
+    size_t max_leaf = 0;
+
+    // Hamerly剪枝的分配, 跳过由距离上下界判定不会改变结果的距离计算
+    bool prune = false;
+
+    // k叉树构造完成后自底向上以凝聚聚类细化, 输出二叉BVH
+    bool refine = false;
+    // 输出节点数组的排列顺序, true为BFS, 否则为DFS
+    bool bfs_layout = false;
+
+    size_t max_iterations() const
+    {
+        if (iterations > 0)
+            return iterations;
+        return converge > 0.0f ? 16 : 2;
+    }
+
+    static BuildOptions& global()
+    {
+        static BuildOptions options;
+        return options;
+    }
+
+    // 解析argv[i], 属于构造参数时返回true
+    bool parse(int argc, char* argv[], int& i)
+    {
+        const char* arg = argv[i];
+        if (strcmp(arg, "--builder") == 0 && i + 1 < argc) {
+            builder = argv[++i];
+            return true;
+        }
+        if (strcmp(arg, "--bins") == 0 && i + 1 < argc) {
+            int value = atoi(argv[++i]);
+            if (value < 2 || value > 1024) {
+                std::cerr << "[WARNING] --bins must be in [2, 1024], keeping " << bins << " bins" << std::endl;
+            } else {
+                bins = static_cast<size_t>(value);
+            }
+            return true;
+        }
+        if (strcmp(arg, "--morton_bits") == 0 && i + 1 < argc) {
+            int value = atoi(argv[++i]);
+            if (value != 30 && value != 63) {
+                std::cerr << "[WARNING] --morton_bits must be 30 or 63, keeping " << morton_bits << std::endl;
+            } else {
+                morton_bits = value;
+            }
+            return true;
+        }
+        if (strcmp(arg, "--ploc_radius") == 0 && i + 1 < argc) {
+            int value = atoi(argv[++i]);
+            if (value < 1 || value > 1024) {
+                std::cerr << "[WARNING] --ploc_radius must be in [1, 1024], keeping " << ploc_radius << std::endl;
+            } else {
+                ploc_radius = static_cast<size_t>(value);
+            }
+            return true;
+        }
+        if (strcmp(arg, "--no_mesh_cache") == 0) {
+            mesh_cache = false;
+            return true;
+        }
+        if (strcmp(arg, "--attributes") == 0) {
+            attributes = true;
+            return true;
+        }
+        if (strcmp(arg, "--task_parallel") == 0) {
+            task_parallel = true;
+            std::cout << "[Log] task-parallel construction enabled" << std::endl;
+            return true;
+        }
+        if (strcmp(arg, "--compare") == 0) {
+            compare = true;
+            return true;
+        }
+        if (strcmp(arg, "--isa") == 0 && i + 1 < argc) {
+            isa = argv[++i];
+            return true;
+        }
+        if (strcmp(arg, "--bench_kernel") == 0) {
+            bench_kernel = true;
+            return true;
+        }
+        if (strcmp(arg, "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], nullptr, 10);
+            return true;
+        }
+        if (strcmp(arg, "--iterations") == 0 && i + 1 < argc) {
+            int value = atoi(argv[++i]);
+            iterations = value > 0 ? static_cast<size_t>(value) : 0;
+            return true;
+        }
+        if (strcmp(arg, "--converge") == 0 && i + 1 < argc) {
+            converge = static_cast<float>(atof(argv[++i]));
+            return true;
+        }
+        if (strcmp(arg, "--sample_threshold") == 0 && i + 1 < argc) {
+            sample_threshold = strtoull(argv[++i], nullptr, 10);
+            return true;
+        }
+        if (strcmp(arg, "--sample_size") == 0 && i + 1 < argc) {
+            sample_size = atof(argv[++i]);
+            return true;
+        }
+        if (strcmp(arg, "--seeding") == 0 && i + 1 < argc) {
+            seeding = argv[++i];
+            return true;
+        }
+        if (strcmp(arg, "--sah_leaf") == 0) {
+            sah_leaf = true;
+            return true;
+        }
+        if (strcmp(arg, "--traversal_cost") == 0 && i + 1 < argc) {
+            traversal_cost = static_cast<float>(atof(argv[++i]));
+            return true;
+        }
+        if (strcmp(arg, "--intersection_cost") == 0 && i + 1 < argc) {
+            intersection_cost = static_cast<float>(atof(argv[++i]));
+            return true;
+        }
+        if (strcmp(arg, "--max_leaf") == 0 && i + 1 < argc) {
+            // 线性BVH的叶子以uint16_t保存图元数
+            int value = atoi(argv[++i]);
+            if (value < 1 || value > 65535) {
+                std::cerr << "[WARNING] --max_leaf must be in [1, 65535], keeping default" << std::endl;
+            } else {
+                max_leaf = static_cast<size_t>(value);
+            }
+            return true;
+        }
+        if (strcmp(arg, "--prune") == 0) {
+            prune = true;
+            return true;
+        }
+        if (strcmp(arg, "--refine") == 0) {
+            refine = true;
+            return true;
+        }
+        if (strcmp(arg, "--layout") == 0 && i + 1 < argc) {
+            const char* value = argv[++i];
+            if (strcmp(value, "bfs") == 0 || strcmp(value, "dfs") == 0) {
+                bfs_layout = strcmp(value, "bfs") == 0;
+            } else {
+                std::cerr << "[WARNING] Unknown --layout '" << value << "', available: dfs, bfs" << std::endl;
+            }
+            return true;
+        }
+        if (strcmp(arg, "--k") == 0 && i + 1 < argc) {
+            // 重排时cluster下标以uint8_t存储
+            int value = atoi(argv[++i]);
+            if (value < 2 || value > 255) {
+                std::cerr << "[WARNING] --k must be in [2, 255], keeping K = " << k << std::endl;
+            } else {
+                k = static_cast<size_t>(value);
+            }
+            return true;
+        }
+        return false;
+    }
+};
+#endif // BUILD_OPTIONS_H_
@@ -1,74 +1,182 @@
 #include "bvh_builder.h"
-#include "construction/timer.hpp"
+#include "binned_sah.hpp"
+#include "kmeans_engine.hpp"
+#include "lbvh.hpp"
+#include "mesh_cache.hpp"
+#include "obj_reader.hpp"
+#include "ploc.hpp"
+
+#include <algorithm>
+#include <chrono>
 
 std::shared_ptr<BVHBuilder> BVHBuilder::LoadFromObj(const std::string& path) {
     // 创建 BVHBuilder 实例
     auto builder = std::make_shared<BVHBuilder>();
     builder->import_path = path;
 
-    objl::Loader loader;
-    bool loadSuccess = loader.LoadFile(path);
-
-    if (!loadSuccess) {
-        std::cerr << "ERROR::MESH::Failed to load OBJ file: " << path << std::endl;
-        return nullptr;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    auto elapsed_ms = [&start_time]() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::high_resolution_clock::now() - start_time).count() / 1000.0;
+    };
+
+    // 缓存以OBJ内容的散列校验, OBJ改变后自动重新解析
+    // 缓存不含属性流, --attributes时总是解析OBJ (仍然写入缓存)
+    const BuildOptions& options = BuildOptions::global();
+    const bool use_cache = options.mesh_cache;
+    const std::string cache_path = mesh_cache::path_for(path);
+    uint64_t source_hash = 0;
+    uint64_t source_size = 0;
+    if (use_cache) {
+        obj::MappedFile source;
+        if (!source.open(path)) {
+            std::cerr << "ERROR::MESH::Failed to load OBJ file: " << path << std::endl;
+            return nullptr;
+        }
+        source_hash = mesh_cache::hash(source.data(), source.size());
+        source_size = source.size();
     }
 
-    // 假设 OBJ 文件只有一个 Mesh
-    objl::Mesh curMesh = loader.LoadedMeshes[0];
-
-    // 先收集所有顶点数据
-    std::vector<Vertex> vertices;
-    for (const auto& vertex : curMesh.Vertices) {
-        vertices.emplace_back(
-            glm::vec3(vertex.Position.X, vertex.Position.Y, vertex.Position.Z),
-            glm::vec3(vertex.Normal.X, vertex.Normal.Y, vertex.Normal.Z),
-            glm::vec2(vertex.TextureCoordinate.X, vertex.TextureCoordinate.Y)
-        );
+    if (use_cache && !options.attributes && mesh_cache::load(cache_path, source_hash, source_size, builder->mesh)) {
+        std::cout << "[Log] Mesh cache hit: " << cache_path << ", loaded in " << elapsed_ms() << " ms, "
+                  << builder->mesh.size() << " triangles" << std::endl;
+    } else {
+        if (use_cache)
+            std::cout << "[Log] Mesh cache miss: " << cache_path << ", parsing OBJ" << std::endl;
+        obj::Stats stats;
+        if (!obj::read(path, builder->mesh, stats, options.attributes)) {
+            std::cerr << "ERROR::MESH::Failed to load OBJ file: " << path << std::endl;
+            return nullptr;
+        }
+        const double load_ms = elapsed_ms();
+        if (stats.skipped > 0)
+            std::cerr << "ERROR::MESH::Skipped " << stats.skipped << " malformed lines or invalid indices in OBJ file" << std::endl;
+
+        const double mb = stats.bytes / (1024.0 * 1024.0);
+        std::cout << "[Log] OBJ loaded: " << mb << " MB in " << load_ms << " ms ("
+                  << (load_ms > 0 ? mb * 1000.0 / load_ms : 0.0) << " MB/s, " << stats.chunks << " chunks), " << builder->mesh.size() << " triangles" << std::endl;
+
+        if (use_cache && !builder->mesh.empty()) {
+            if (mesh_cache::store(cache_path, source_hash, source_size, builder->mesh)) {
+                std::cout << "[Log] Mesh cache written: " << cache_path << std::endl;
+            } else {
+                std::cerr << "[WARNING] Failed to write mesh cache " << cache_path << std::endl;
+            }
+        }
     }
 
-    // 根据indice, 创建图元Primitive
-    auto indices = curMesh.Indices;
-    for (size_t i = 0; i < indices.size(); i += 3) {
-        // 确保不会越界
-        if (i + 2 >= indices.size()) break;
-
-        // 获取三个顶点的索引
-        unsigned int idx0 = indices[i];
-        unsigned int idx1 = indices[i+1];
-        unsigned int idx2 = indices[i+2];
-
-        // 确保索引有效
-        if (idx0 >= vertices.size() || idx1 >= vertices.size() || idx2 >= vertices.size()) {
-            std::cerr << "ERROR::MESH::Invalid vertex index in OBJ file" << std::endl;
-            continue;
-        }
+    if (builder->mesh.empty()) {
+        std::cerr << "ERROR::MESH::No triangles in OBJ file: " << path << std::endl;
+        return nullptr;
+    }
 
-        // 创建三角形并添加到builder中
-        auto pri = Primitive(vertices[idx0], vertices[idx1], vertices[idx2]);
-        builder->pri.push_back(pri);
+    // 所有对象合并为一个构造输入, 每个三角形记录所属的对象
+    builder->mesh.assignObjects();
+    const TriangleMesh& mesh = builder->mesh;
+    if (mesh.objectCount() > 1) {
+        size_t largest = 0;
+        for (size_t o = 0; o < mesh.objectCount(); ++o)
+            largest = std::max(largest, mesh.objectSize(o));
+        std::cout << "[Log] OBJ objects: " << mesh.objectCount() << " (largest " << largest << " triangles)" << std::endl;
     }
 
+    // 每个三角形的内存: 索引存储 (位置按三角形数均摊) 与原来每个三角形3个完整Vertex的Primitive
+    std::cout << "[Log] Mesh memory: " << (double)mesh.geometryBytes() / mesh.size() << " bytes/triangle (positions + indices, "
+              << mesh.positions.size() << " positions) + " << (double)mesh.attributeBytes() / mesh.size() << " bytes/triangle ("
+              << (mesh.hasAttributes() ? "object ids, normals, texcoords" : "object ids") << "), was " << sizeof(Primitive)
+              << " bytes/triangle as Primitive" << std::endl;
+
     return builder; // 返回智能指针
 }
 
-void BVHBuilder::Build() {
-    // 转换操作
-    std::vector<Primitive*> p_pri;
-    p_pri.reserve(pri.size());
-    for (auto& pri_i : pri) {
-        p_pri.push_back(&pri_i);
-    }
-
-    Kmeans *k = new Kmeans(2, 8, 5, p_pri);
-    k->registerCallback(m_callback);
+std::unique_ptr<BuildEngine> BVHBuilder::CreateEngine(const std::string& name) const {
+    const BuildOptions& options = BuildOptions::global();
+    const LinearBVH::Layout layout = options.bfs_layout ? LinearBVH::Layout::BFS : LinearBVH::Layout::DFS;
 
-    // 创建表头
-    timer::create_k_means_header();
-
-    std::cout << "[Log] K-means BVH Building..." << std::endl;
+    if (name == "binned") {
+        return std::unique_ptr<BuildEngine>(new BinnedSAH(options.bins, options.traversal_cost, options.intersection_cost,
+                                                          options.max_leaf, options.task_parallel, layout));
+    }
+    if (name == "lbvh") {
+        return std::unique_ptr<BuildEngine>(new LBVH(options.morton_bits, options.max_leaf, layout));
+    }
+    if (name == "ploc") {
+        return std::unique_ptr<BuildEngine>(new PLOC(options.ploc_radius, options.morton_bits, options.max_leaf, layout));
+    }
+    if (!name.empty() && name != "kmeans") {
+        std::cerr << "[WARNING] Unknown --builder '" << name << "', available: kmeans, binned, lbvh, ploc, all" << std::endl;
+    }
+    return std::unique_ptr<BuildEngine>(new KmeansEngine(m_callback));
+}
 
-    k->constructKaryTree(0);
+void BVHBuilder::Build() {
+    const BuildOptions& options = BuildOptions::global();
+
+    // --builder all: 在同一份图元上依次运行所有engine并列出对比, 保留k-means的结果
+    std::vector<std::string> names;
+    if (options.builder == "all") {
+        names = { "kmeans", "binned", "lbvh", "ploc" };
+    } else {
+        names.push_back(options.builder);
+    }
 
-    std::cout << "[Log] K-means BVH Building Completed" << std::endl;
-}
\ No newline at end of file
+    struct Row {
+        std::string name;
+        long long build_us;
+        double sah;
+        size_t nodes;
+    };
+    std::vector<Row> rows;
+
+#if defined(_OPENMP) && _OPENMP < 200805
+    // OpenMP 3.0之前没有task, 编译器忽略task/taskloop, 递归与分块在单线程上依次执行 (MSVC需要/openmp:llvm)
+    std::cout << "[WARNING] OpenMP " << _OPENMP << " has no tasks, recursive builds run serially" << std::endl;
+#endif
+
+    for (size_t e = 0; e < names.size(); ++e) {
+        // 预计算所有图元的包围盒 (SoA), 构造过程共享, 根节点拥有整个区间
+        m_bounds.build(mesh);
+
+        std::unique_ptr<BuildEngine> engine = CreateEngine(names[e]);
+        LinearBVH bvh;
+        engine->prepare(mesh, m_bounds);
+
+        auto start_time = std::chrono::high_resolution_clock::now();
+
+        // 本次构造的所有节点都分配在arena中, 构造结束后一次性释放
+        Arena arena;
+        engine->build(mesh, m_bounds, arena, bvh);
+
+        auto end_time = std::chrono::high_resolution_clock::now();
+        long long elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
+
+        // 各engine的共同报告, 便于对比
+        const double sah = bvh.sahCost(options.traversal_cost, options.intersection_cost);
+        std::cout << "[Log] " << engine->name() << " build (including flatten): " << elapsed_us << " us" << std::endl;
+        std::cout << "[Log] " << engine->name() << " BVH SAH cost: " << sah << std::endl;
+        std::cout << "[Log] Construction arena peak: " << arena.bytes_reserved() / 1024 << " KB reserved, "
+                  << arena.bytes_used() / 1024 << " KB used" << std::endl;
+        rows.push_back(Row{ engine->name(), elapsed_us, sah, bvh.nodes.size() });
+
+        if (e == 0) {
+            // 按第一个engine的槽位顺序重排三角形
+            start_time = std::chrono::high_resolution_clock::now();
+            m_bvh = std::move(bvh);
+            m_bvh.reorder(mesh, m_bounds);
+            end_time = std::chrono::high_resolution_clock::now();
+            long long reorder_us = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
+            std::cout << "[Log] Linear BVH (" << (options.bfs_layout ? "BFS" : "DFS") << "): " << m_bvh.nodes.size() << " nodes, "
+                      << m_bvh.bytes() / 1024 << " KB, triangles reordered in " << reorder_us << " us" << std::endl;
+        }
+    }
+    // 释放构造用的包围盒
+    m_bounds = PrimitiveBounds();
+
+    if (rows.size() > 1) {
+        std::cout << "[Log] Builder comparison (" << mesh.size() << " primitives):" << std::endl;
+        for (const Row& row : rows) {
+            std::cout << "[Log]   " << row.name << std::string(row.name.size() < 12 ? 12 - row.name.size() : 0, ' ')
+                      << row.build_us << " us, SAH " << row.sah << ", " << row.nodes << " nodes" << std::endl;
+        }
+    }
+}
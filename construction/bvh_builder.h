@@ -2,8 +2,12 @@
 #define BVH_BUILDER_H_
 
 #include "bbox.hpp"
-#include "primitive.h"
+#include "triangle_mesh.hpp"
 #include "kmeans.hpp"
+#include "primitive_bounds.hpp"
+#include "build_options.hpp"
+#include "linear_bvh.hpp"
+#include "build_engine.hpp"
 
 #include <functional>
 #include <memory>
@@ -11,18 +15,25 @@
 #include <vector>
 #include <iostream>
 
-#include "OBJ_Loader.h"
-
 class BVHBuilder {
 public:
     std::string import_path = "";
 
     static std::shared_ptr<BVHBuilder> LoadFromObj(const std::string& path);
-    const std::vector<Primitive>& GetPrimitives() const { return pri; }
+    const TriangleMesh& GetMesh() const { return mesh; }
     void SetCallback(std::function<void(const BoundingBox, const bool)> callback) { m_callback = callback; }
+    // 用 --builder 选择的engine构造, 输出m_bvh; all时依次运行所有engine并打印对比
     void Build();
+    // 构造结果: 线性化的节点数组与重排后的三角形下标, Build()之后有效
+    const LinearBVH& GetBVH() const { return m_bvh; }
 private:
-    std::vector<Primitive> pri;
+    std::unique_ptr<BuildEngine> CreateEngine(const std::string& name) const;
+
+    // 索引三角形网格, 构造只读取位置与下标
+    TriangleMesh mesh;
+    // 图元包围盒的SoA存储, Build()时构造
+    PrimitiveBounds m_bounds;
     std::function<void(const BoundingBox, const bool)> m_callback;
+    LinearBVH m_bvh;
 };
 #endif // BVH_BUILDER_H_
\ No newline at end of file
@@ -10,30 +10,33 @@ class Cluster
 public:
     BoundingBox world;
     BoundingBox representive;
-    std::vector<size_t> indexOfPrimitives;
+    // 最近一次分配到该cluster的图元数 (图元本身由PrimitiveBounds::label记录)
+    size_t count = 0;
+    // 节点重排后该cluster在PrimitiveBounds中占据的槽位区间[begin, end)
+    size_t begin = 0;
+    size_t end = 0;
+
+    // 重排 (Kmeans::partition) 之后的图元数
+    size_t size() const { return end - begin; }
 
     glm::vec3 m_min;
     glm::vec3 m_max;
 
-    // 更新中心点
+    // 更新中心点, 空cluster保留原来的中心点 (由Kmeans重新选取)
     void updateRepresentive()
     {
-        const float inv_size = 1.0f / indexOfPrimitives.size();
+        if (count == 0)
+            return;
+        const float inv_size = 1.0f / count;
         representive = BoundingBox(m_min * inv_size, m_max * inv_size);
     }
 
     void reset()
     {
-        m_min *= 0;
-        m_max *= 0;
-    }
-
-    void add(size_t i, BoundingBox bb)
-    {
-        indexOfPrimitives.push_back(i);
-        m_min += bb.min;
-        m_max += bb.max;
-        world.expand(bb);
+        // 首次reset时m_min/m_max尚未初始化, 不能用乘0清零 (NaN * 0 仍为NaN)
+        m_min = glm::vec3(0.0f);
+        m_max = glm::vec3(0.0f);
+        count = 0;
     }
 };
 #endif // CLUSTER_H_
\ No newline at end of file
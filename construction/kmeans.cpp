@@ -3,61 +3,314 @@
 #include "primitive.h"
 #include "../visualization/BVH.h"
 #include "construction/timer.hpp"
+#include "nearest_kernel.hpp"
+#include "random.hpp"
 
-#include <ctime>
+#include <atomic>
 #include <iostream>
 #include <stdlib.h>
+#include <algorithm>
+#include <array>
 #include <vector>
 #include <chrono>  // 用于计时
 #include <fstream> // 用于写入CSV文件
 
 using namespace std;
 #define maxLeafNum 4
+// 小于该图元数的子树不再单独生成task, 直接在当前线程构造
+#define minTaskSize 256
+// 每个数据并行块的图元数
+#define assignBlockSize 1024
 
-static int UNIQUE_ID = 0;
+static std::atomic<int> UNIQUE_ID(0);
 
-Kmeans::Kmeans(size_t iterCount, size_t K, size_t P, vector<Primitive *> primitives)
-// 迭代次数、聚类数、随机点数、集几何体
+Kmeans::Kmeans(size_t iterCount, size_t K, size_t P, PrimitiveBounds *bounds, Arena *arena, size_t begin, size_t end, uint64_t seed, uint64_t path)
+// 迭代次数、聚类数、随机点数、共享的图元包围盒、本次构造的arena、集几何体(bounds中的槽位区间)、随机种子、节点路径
 {
     m_iterations = iterCount;
     m_K = K;
     m_P = P;
     this->unique_id = UNIQUE_ID++;
-    this->primitives = primitives;
-    cluster = new Cluster[m_K];
-    children = new Kmeans *[m_K];
+    this->bounds = bounds;
+    this->arena = arena;
+    this->m_begin = begin;
+    this->m_end = end;
+    this->m_seed = seed;
+    this->m_path = path;
+    cluster = arena->create_array<Cluster>(m_K);
+    children = arena->create_array<Kmeans *>(m_K);
+    root = NULL;
+    agglomerative_nodes = NULL;
     children_existence = std::vector<bool>(m_K, true);
+    m_assign = assignKernel(m_K);
+    m_convergence = 0.0f;
+    m_sampleThreshold = 0;
+    m_sampleSize = 0.0;
+    iterations_used = 0;
+    m_pruning = false;
+    distance_evaluations = 0;
+    distance_avoided = 0;
     BoundingBox cur_world;
-    for (size_t i = 0; i < primitives.size(); ++i)
+    for (size_t i = m_begin; i < m_end; ++i)
     {
-        cur_world.expand(primitives[i]->get_bbox());
+        cur_world.expand(bounds->get_bbox(i));
     }
     world = cur_world;
+    m_seeding = Seeding::Heuristic;
+    median_split = false;
+    collapsed = false;
+}
+
+// 按块数据并行执行body(block): 非任务模式用parallel for, 任务模式用taskloop (同assign)
+template <typename F>
+static void parallel_blocks(bool task_parallel, int block_count, F &&body)
+{
+    if (block_count <= 1)
+    {
+        for (int block = 0; block < block_count; ++block)
+            body(block);
+    }
+    else if (!task_parallel)
+    {
+        #pragma omp parallel for schedule(static)
+        for (int block = 0; block < block_count; ++block)
+            body(block);
+    }
+    else
+    {
+        #pragma omp taskloop grainsize(1) default(shared)
+        for (int block = 0; block < block_count; ++block)
+            body(block);
+    }
+}
 
-    std::vector<BoundingBox> kCentroids = getRandCentroidsOnMesh(m_K, m_P);
+// 与最近centroid kernel相同的距离
+static inline float seed_distance(const PrimitiveBounds &store, size_t slot, const BoundingBox &c)
+{
+    const glm::vec3 dmin = store.min(slot) - c.min;
+    const glm::vec3 dmax = store.max(slot) - c.max;
+    return glm::length(dmin) + glm::length(dmax);
+}
+
+void Kmeans::initCentroids(PrimitiveBounds &store, size_t begin, size_t end)
+{
+    std::vector<BoundingBox> kCentroids;
+    switch (m_seeding)
+    {
+    case Seeding::PlusPlus:
+        kCentroids = seedPlusPlus(store, begin, end);
+        break;
+    case Seeding::Parallel:
+        kCentroids = seedParallel(store, begin, end);
+        break;
+    default:
+        kCentroids = getRandCentroidsOnMesh(store, begin, end, m_K, m_P);
+        break;
+    }
     for (size_t i = 0; i < m_K; ++i)
     {
         cluster[i].representive = kCentroids[i];
     }
 }
 
-Kmeans::~Kmeans()
+// 在D²的前缀和上查找r所在的槽位, block_sum为各块D²之和
+static size_t sample_d2(const std::vector<float> &d2, const std::vector<double> &block_sum, double r)
+{
+    int block = 0;
+    while (block + 1 < (int)block_sum.size() && r >= block_sum[block])
+    {
+        r -= block_sum[block];
+        ++block;
+    }
+    const size_t first = (size_t)block * assignBlockSize;
+    const size_t last = std::min(first + assignBlockSize, d2.size());
+    for (size_t i = first; i < last; ++i)
+    {
+        if (r < d2[i])
+            return i;
+        r -= d2[i];
+    }
+    // 舍入误差: 取块内最后一个D²非零的槽位
+    for (size_t i = last; i-- > first;)
+    {
+        if (d2[i] > 0.0f)
+            return i;
+    }
+    return first;
+}
+
+// k-means++ (Arthur & Vassilvitskii 2007)
+// 每选出一个centroid, 按块并行地更新到最近centroid的D², 块内求和后按块的顺序累加, 结果与线程数无关
+vector<BoundingBox> Kmeans::seedPlusPlus(PrimitiveBounds &store, size_t begin, size_t end)
+{
+    const size_t total_size = end - begin;
+    const int block_count = (int)((total_size + assignBlockSize - 1) / assignBlockSize);
+    CounterRng rng(m_seed, m_path);
+
+    vector<BoundingBox> kCentroids;
+    kCentroids.push_back(store.get_bbox(begin + rng.uniform(total_size)));
+
+    std::vector<float> d2(total_size, INF_F);
+    std::vector<double> block_sum(block_count, 0.0);
+    while (kCentroids.size() < m_K)
+    {
+        const BoundingBox latest = kCentroids.back();
+        parallel_blocks(task_parallel, block_count, [&](int block) {
+            const size_t first = (size_t)block * assignBlockSize;
+            const size_t last = std::min(first + assignBlockSize, total_size);
+            double sum = 0.0;
+            for (size_t i = first; i < last; ++i)
+            {
+                const float d = seed_distance(store, begin + i, latest);
+                d2[i] = std::min(d2[i], d * d);
+                sum += d2[i];
+            }
+            block_sum[block] = sum;
+        });
+
+        double total = 0.0;
+        for (int block = 0; block < block_count; ++block)
+            total += block_sum[block];
+        // 所有图元都与已选的centroid重合时只能均匀选取
+        const size_t i = total > 0.0 ? sample_d2(d2, block_sum, rng.uniform_real() * total) : rng.uniform(total_size);
+        kCentroids.push_back(store.get_bbox(begin + i));
+    }
+    return kCentroids;
+}
+
+// Scalable k-means++ (Bahmani et al. 2012)
+// 每轮对每个图元以 min(1, l * D² / sum(D²)) 的概率独立采样 (l = 2K), 轮数远少于K,
+// 各块用自己的随机序列, 候选按块的顺序合并; 最后以每个候选最近的图元数为权重做k-means++
+vector<BoundingBox> Kmeans::seedParallel(PrimitiveBounds &store, size_t begin, size_t end)
 {
-    delete[] cluster;
+    const size_t rounds = 5;
+    const double oversampling = 2.0 * m_K;
+    const size_t total_size = end - begin;
+    const int block_count = (int)((total_size + assignBlockSize - 1) / assignBlockSize);
+    CounterRng rng(m_seed, m_path);
+
+    vector<BoundingBox> candidates;
+    candidates.push_back(store.get_bbox(begin + rng.uniform(total_size)));
+
+    std::vector<float> d2(total_size, INF_F);
+    std::vector<uint32_t> nearest(total_size, 0);
+    std::vector<double> block_sum(block_count, 0.0);
+    std::vector<std::vector<uint32_t>> block_picked(block_count);
+    // 用[first_new, candidates.size())内的新候选更新D²和最近的候选
+    auto update = [&](size_t first_new) {
+        parallel_blocks(task_parallel, block_count, [&](int block) {
+            const size_t first = (size_t)block * assignBlockSize;
+            const size_t last = std::min(first + assignBlockSize, total_size);
+            double sum = 0.0;
+            for (size_t i = first; i < last; ++i)
+            {
+                for (size_t c = first_new; c < candidates.size(); ++c)
+                {
+                    const float d = seed_distance(store, begin + i, candidates[c]);
+                    if (d * d < d2[i])
+                    {
+                        d2[i] = d * d;
+                        nearest[i] = (uint32_t)c;
+                    }
+                }
+                sum += d2[i];
+            }
+            block_sum[block] = sum;
+        });
+    };
+    update(0);
+
+    for (size_t round = 0; round < rounds; ++round)
+    {
+        double total = 0.0;
+        for (int block = 0; block < block_count; ++block)
+            total += block_sum[block];
+        if (total <= 0.0)
+            break;
+
+        const uint64_t round_key = CounterRng::child_key(~m_path, round);
+        parallel_blocks(task_parallel, block_count, [&](int block) {
+            CounterRng block_rng(m_seed, CounterRng::child_key(round_key, block));
+            const size_t first = (size_t)block * assignBlockSize;
+            const size_t last = std::min(first + assignBlockSize, total_size);
+            block_picked[block].clear();
+            for (size_t i = first; i < last; ++i)
+            {
+                if (block_rng.uniform_real() < oversampling * d2[i] / total)
+                    block_picked[block].push_back((uint32_t)i);
+            }
+        });
+
+        const size_t first_new = candidates.size();
+        for (int block = 0; block < block_count; ++block)
+        {
+            for (uint32_t i : block_picked[block])
+                candidates.push_back(store.get_bbox(begin + i));
+        }
+        update(first_new);
+    }
+
+    // 候选不足K个 (图元很少或大量重合) 时直接使用全部候选, 不足的部分均匀选取
+    vector<BoundingBox> kCentroids;
+    if (candidates.size() <= m_K)
+    {
+        kCentroids = candidates;
+        while (kCentroids.size() < m_K)
+            kCentroids.push_back(store.get_bbox(begin + rng.uniform(total_size)));
+        return kCentroids;
+    }
+
+    // 在带权的候选上做k-means++, 候选数约为 rounds * 2K, 串行即可
+    std::vector<double> weight(candidates.size(), 0.0);
+    for (size_t i = 0; i < total_size; ++i)
+        weight[nearest[i]] += 1.0;
+
+    auto pick = [&](const std::vector<double> &score) {
+        double total = 0.0;
+        for (double s : score)
+            total += s;
+        double r = rng.uniform_real() * total;
+        for (size_t c = 0; c < score.size(); ++c)
+        {
+            if (r < score[c])
+                return c;
+            r -= score[c];
+        }
+        return score.size() - 1;
+    };
+    auto candidate_distance = [](const BoundingBox &a, const BoundingBox &b) {
+        return glm::length(a.min - b.min) + glm::length(a.max - b.max);
+    };
+
+    kCentroids.push_back(candidates[pick(weight)]);
+    std::vector<double> cd2(candidates.size(), INF_D);
+    std::vector<double> score(candidates.size());
+    while (kCentroids.size() < m_K)
+    {
+        for (size_t c = 0; c < candidates.size(); ++c)
+        {
+            const double d = candidate_distance(candidates[c], kCentroids.back());
+            cd2[c] = std::min(cd2[c], d * d);
+            score[c] = weight[c] * cd2[c];
+        }
+        kCentroids.push_back(candidates[pick(score)]);
+    }
+    return kCentroids;
 }
 
-// 随机选择在模型上的点而不是空间内的点
-vector<BoundingBox> Kmeans::getRandCentroidsOnMesh(int k, int p)
+// 随机选择在模型上的点而不是空间内的点, 采样的节点只在采样上选择
+vector<BoundingBox> Kmeans::getRandCentroidsOnMesh(PrimitiveBounds &store, size_t begin, size_t end, int k, int p)
 {
     vector<BoundingBox> kCentroids;
     size_t idx_primitive;
 
+    // 每个节点独立的随机序列, 与线程数和构造顺序无关
+    CounterRng rng(m_seed, m_path);
+
     // 第一个随机点
-    srand((unsigned)time(NULL));
-    idx_primitive = rand() % primitives.size();
-    kCentroids.push_back(primitives[idx_primitive]->get_bbox());
+    idx_primitive = begin + rng.uniform(end - begin);
+    kCentroids.push_back(store.get_bbox(idx_primitive));
 
-    srand((unsigned)time(NULL));
     // 选取之后k-1个点
     for (int i = 1; i < k; ++i)
     {
@@ -66,8 +319,8 @@ vector<BoundingBox> Kmeans::getRandCentroidsOnMesh(int k, int p)
         tempP.reserve(p);
         for (int j = 0; j < p; j++)
         {
-            idx_primitive = rand() % primitives.size();
-            tempP.push_back(primitives[idx_primitive]->get_bbox());
+            idx_primitive = begin + rng.uniform(end - begin);
+            tempP.push_back(store.get_bbox(idx_primitive));
         }
 
         // 选取与之前算出的点距离最远的点作为下一个representive
@@ -76,7 +329,7 @@ vector<BoundingBox> Kmeans::getRandCentroidsOnMesh(int k, int p)
         for (int k = 0; k < p; k++)
         {
             float local_maxDistance = -1.0f;
-            for (int q = 0; q < kCentroids.size(); q++)
+            for (size_t q = 0; q < kCentroids.size(); q++)
             {
                 BoundingBox bb;
                 bb.expand(tempP[k]);
@@ -103,14 +356,6 @@ vector<BoundingBox> Kmeans::getRandCentroidsOnMesh(int k, int p)
     return kCentroids;
 }
 
-float Kmeans::calDistance(BoundingBox b1, BoundingBox b2)
-{
-    double min_value = glm::length(b1.min - b2.min);
-    double max_value = glm::length(b1.max - b2.max);
-    double res = min_value + max_value;
-    return res;
-}
-
 void Kmeans::registerCallback(std::function<void(const BoundingBox, const bool)> func)
 {
     callback_func = func;
@@ -123,19 +368,74 @@ void Kmeans::constructKaryTree(int depth)
     // 计时开始
     auto start_time = std::chrono::high_resolution_clock::now();
 
+    // 按SAH退化为叶子: 记录时间并通知visualization, 由父节点在taskwait之后改为叶子cluster
+    auto collapse = [&]() {
+        collapsed = true;
+        children_existence.assign(m_K, false);
+        auto end_time = std::chrono::high_resolution_clock::now();
+        auto elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
+        timer::write_k_means_time(this->unique_id, depth, elapsed_us.count(), iterations_used);
+        if (callback_func)
+        {
+            callback_func(this->world, true);
+        }
+    };
+
+    // SAH: 叶子代价 Ci * N * SA(本节点), 划分代价 Ct * SA(本节点) + sum(Ci * N_c * SA(c)), 同除以SA(根节点)
+    const size_t total_size = m_end - m_begin;
+    const bool sah_candidate = m_leafPolicy.sah && depth > 0 && total_size <= maxLeafSize();
+    const double leaf_cost = m_leafPolicy.intersection * world.surface_area() * total_size;
+    if (sah_candidate)
+    {
+        // 聚类前的下界: 每个图元都在其cluster的包围盒内, 故 sum(N_c * SA(c)) >= sum(SA(图元))
+        // 叶子不比下界贵时划分不可能更便宜, 不必运行k-means
+        double split_bound = m_leafPolicy.traversal * world.surface_area();
+        for (size_t i = m_begin; i < m_end; ++i)
+            split_bound += m_leafPolicy.intersection * bounds->get_bbox(i).surface_area();
+        if (leaf_cost <= split_bound)
+        {
+            collapse();
+            return;
+        }
+    }
+
     // 构造本层结构
     this->run();
+    // 按cluster原地重排, 子节点直接使用各自的子区间
+    this->partition();
+
+    if (sah_candidate)
+    {
+        double split_cost = m_leafPolicy.traversal * world.surface_area();
+        for (size_t i = 0; i < m_K; ++i)
+            split_cost += m_leafPolicy.intersection * cluster[i].world.surface_area() * cluster[i].size();
+        if (leaf_cost <= split_cost)
+        {
+            collapse();
+            return;
+        }
+    }
+
+    // 全部图元仍在同一个cluster中时子节点会重复划分同一个集合, 改用中位数划分保证深度为O(log n)
+    for (size_t i = 0; i < m_K; ++i)
+    {
+        if (cluster[i].size() == total_size && !isLeafCluster(total_size))
+        {
+            this->medianSplit();
+            break;
+        }
+    }
 
     // 计时结束
     auto end_time = std::chrono::high_resolution_clock::now();
     auto elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
-    timer::write_k_means_time(this->unique_id, depth, elapsed_us.count());
+    timer::write_k_means_time(this->unique_id, depth, elapsed_us.count(), iterations_used);
 
     // 判定子节点是否是叶子节点
     for (size_t i = 0; i < m_K; i++)
     {
         // 叶子cluster 该cluster[i]对应的children为NULL
-        if (cluster[i].indexOfPrimitives.size() < maxLeafNum * m_K)
+        if (isLeafCluster(cluster[i].size()))
         {
             children_existence[i] = false;
             if (callback_func)
@@ -156,223 +456,694 @@ void Kmeans::constructKaryTree(int depth)
         // 跳过叶子children
         if (!children_existence[i])
             continue;
-        // 否则DFS
-        vector<Primitive *> pTemp;
-        for (size_t p = 0; p < cluster[i].indexOfPrimitives.size(); ++p)
+        // 否则DFS, 任务模式下兄弟子树互不依赖, 作为task并行构造
+        #pragma omp task default(shared) firstprivate(i, depth) \
+            if(task_parallel && cluster[i].size() >= minTaskSize)
         {
-            pTemp.push_back(primitives[cluster[i].indexOfPrimitives[p]]);
+            children[i] = arena->create<Kmeans>(m_iterations, m_K, m_P, bounds, arena, cluster[i].begin, cluster[i].end,
+                                                m_seed, CounterRng::child_key(m_path, i));
+            children[i]->setTaskParallel(task_parallel);
+            children[i]->setConvergence(m_convergence);
+            children[i]->setSampling(m_sampleThreshold, m_sampleSize);
+            children[i]->setPruning(m_pruning);
+            children[i]->setSeeding(m_seeding);
+            children[i]->setLeafPolicy(m_leafPolicy);
+            if (callback_func)
+            {
+                children[i]->registerCallback(callback_func);
+            }
+            children[i]->constructKaryTree(depth + 1);
         }
-        children[i] = new Kmeans(m_iterations, m_K, m_P, pTemp);
-        if (callback_func)
+    }
+    #pragma omp taskwait
+
+    // 按SAH退化为叶子的子节点, 对应的cluster改为叶子
+    for (size_t i = 0; i < m_K; i++)
+    {
+        if (children_existence[i] && children[i]->collapsed)
+            children_existence[i] = false;
+    }
+}
+
+size_t Kmeans::maxLeafSize() const
+{
+    return m_leafPolicy.max_leaf > 0 ? m_leafPolicy.max_leaf : maxLeafNum * m_K;
+}
+
+bool Kmeans::isLeafCluster(size_t n) const
+{
+    // 指定--max_leaf时与其它构造方式一致, 图元数不超过上限即为叶子
+    if (!m_leafPolicy.sah)
+        return m_leafPolicy.max_leaf > 0 ? n <= m_leafPolicy.max_leaf : n < maxLeafNum * m_K;
+    // SAH模式下由子节点聚类后自己判定
+    return n <= 1;
+}
+
+// 按最后一次分配写入的label把本节点的槽位区间重排为每个cluster一段连续区间
+// 大节点: 并行的稳定计数排序 (按块统计直方图, 前缀和, 按块并行写入临时存储再拷回)
+// 小节点: American flag sort 原地K路分区, 不分配额外内存
+void Kmeans::partition()
+{
+    const uint8_t *label = bounds->label.data();
+    const size_t total_size = m_end - m_begin;
+
+    size_t offset = m_begin;
+    for (size_t c = 0; c < m_K; ++c)
+    {
+        cluster[c].begin = offset;
+        cluster[c].end = offset + cluster[c].count;
+        offset += cluster[c].count;
+    }
+
+    if (total_size > assignBlockSize)
+    {
+        const int block_count = (int)((total_size + assignBlockSize - 1) / assignBlockSize);
+        auto block_range = [&](int block) {
+            const size_t block_begin = m_begin + (size_t)block * assignBlockSize;
+            return std::make_pair(block_begin, std::min(block_begin + assignBlockSize, m_end));
+        };
+        // 每块中各cluster的第一个写入位置 (先统计个数, 再转为前缀和)
+        std::vector<size_t> block_offset(block_count * m_K, 0);
+        std::vector<BoundingBox> block_world(block_count * m_K);
+        auto count_block = [&](int block) {
+            const auto range = block_range(block);
+            for (size_t slot = range.first; slot < range.second; ++slot)
+            {
+                ++block_offset[block * m_K + label[slot]];
+                block_world[block * m_K + label[slot]].expand(bounds->get_bbox(slot));
+            }
+        };
+
+        PrimitiveBounds sorted;
+        sorted.resize(total_size);
+        auto scatter_block = [&](int block) {
+            const auto range = block_range(block);
+            size_t *cursor = &block_offset[block * m_K];
+            for (size_t slot = range.first; slot < range.second; ++slot)
+                sorted.copy(cursor[label[slot]]++ - m_begin, *bounds, slot);
+        };
+        auto copy_back_block = [&](int block) {
+            const auto range = block_range(block);
+            for (size_t slot = range.first; slot < range.second; ++slot)
+                bounds->copy(slot, sorted, slot - m_begin);
+        };
+
+        if (!task_parallel)
+        {
+            #pragma omp parallel for schedule(static)
+            for (int block = 0; block < block_count; ++block)
+                count_block(block);
+        }
+        else
         {
-            children[i]->registerCallback(callback_func);
+            #pragma omp taskloop grainsize(1) default(shared)
+            for (int block = 0; block < block_count; ++block)
+                count_block(block);
         }
-        children[i]->constructKaryTree(depth + 1);
+
+        for (size_t c = 0; c < m_K; ++c)
+        {
+            size_t position = cluster[c].begin;
+            BoundingBox cluster_world;
+            for (int block = 0; block < block_count; ++block)
+            {
+                const size_t n = block_offset[block * m_K + c];
+                block_offset[block * m_K + c] = position;
+                position += n;
+                cluster_world.expand(block_world[block * m_K + c]);
+            }
+            cluster[c].world = cluster_world;
+        }
+
+        if (!task_parallel)
+        {
+            #pragma omp parallel for schedule(static)
+            for (int block = 0; block < block_count; ++block)
+                scatter_block(block);
+            #pragma omp parallel for schedule(static)
+            for (int block = 0; block < block_count; ++block)
+                copy_back_block(block);
+        }
+        else
+        {
+            #pragma omp taskloop grainsize(1) default(shared)
+            for (int block = 0; block < block_count; ++block)
+                scatter_block(block);
+            #pragma omp taskloop grainsize(1) default(shared)
+            for (int block = 0; block < block_count; ++block)
+                copy_back_block(block);
+        }
+        return;
+    }
+
+    // end 在交换过程中作为写入游标
+    for (size_t c = 0; c < m_K; ++c)
+        cluster[c].end = cluster[c].begin;
+    for (size_t c = 0; c < m_K; ++c)
+    {
+        const size_t stop = cluster[c].begin + cluster[c].count;
+        while (cluster[c].end < stop)
+        {
+            const size_t slot = cluster[c].end;
+            const uint8_t l = label[slot];
+            if (l == c)
+                ++cluster[c].end;
+            else
+                bounds->swap(slot, cluster[l].end++);
+        }
+        // 顺便求出cluster的实际包围盒
+        BoundingBox cluster_world;
+        for (size_t slot = cluster[c].begin; slot < cluster[c].end; ++slot)
+            cluster_world.expand(bounds->get_bbox(slot));
+        cluster[c].world = cluster_world;
     }
 }
 
 // refinement of K-means tree using agglomerative clustering
 void Kmeans::buttom2Top()
 {
+    // 本层的凝聚聚类只依赖本层cluster的包围盒, 与子树互不依赖
     this->root = agglomerativeClustering();
     for (size_t i = 0; i < this->m_K; ++i)
     {
-        if (children[i] != NULL)
-            this->children[i]->buttom2Top();
+        if (!children_existence[i])
+            continue;
+        #pragma omp task default(shared) firstprivate(i) \
+            if(task_parallel && cluster[i].size() >= minTaskSize)
+        this->children[i]->buttom2Top();
+    }
+    #pragma omp taskwait
+
+    // 叶子按非空cluster的顺序排列, 有子节点的cluster用子节点的二叉树根替换对应叶子
+    size_t leaf = 0;
+    for (size_t i = 0; i < this->m_K; ++i)
+    {
+        if (cluster[i].size() == 0)
+            continue;
+        if (children_existence[i])
+            agglomerative_nodes[leaf] = *children[i]->root;
+        ++leaf;
     }
 }
 
-// Fast Agglomerative Clustering for Rendering
-// https://www.graphics.cornell.edu/~bjw/IRT08Agglomerative.pdf
-KBVHNode *Kmeans::agglomerativeClustering()
+double KBVHNode::sahCost(float traversal, float intersection) const
+{
+    if (isLeaf())
+        return bb.surface_area() * count * intersection;
+    return bb.surface_area() * traversal + l->sahCost(traversal, intersection) + r->sahCost(traversal, intersection);
+}
+
+double Kmeans::sahCost(float traversal, float intersection) const
 {
-    vector<KBVHNode *> v;
+    double cost = world.surface_area() * traversal;
     for (size_t i = 0; i < m_K; ++i)
     {
-        BoundingBox bb;
+        if (children_existence[i])
+            cost += children[i]->sahCost(traversal, intersection);
+        else if (cluster[i].size() > 0)
+            cost += cluster[i].world.surface_area() * cluster[i].size() * intersection;
+    }
+    return cost;
+}
 
-        if (cluster[i].indexOfPrimitives.size() > 0)
+// 以本层非空的cluster为叶子凝聚聚类, 见 agglomerative.hpp
+KBVHNode *Kmeans::agglomerativeClustering()
+{
+    vector<BoundingBox> boxes;
+    vector<uint32_t> counts;
+    vector<size_t> leaf_cluster;
+    for (size_t i = 0; i < m_K; ++i)
+    {
+        if (cluster[i].size() > 0)
         {
-            for (size_t j = 0; j < cluster[i].indexOfPrimitives.size(); ++j)
-                bb.expand(primitives[cluster[i].indexOfPrimitives[j]]->get_bbox());
-
-            v.push_back(new KBVHNode(bb, cluster[i]));
+            boxes.push_back(cluster[i].world);
+            counts.push_back(static_cast<uint32_t>(cluster[i].size()));
+            leaf_cluster.push_back(i);
         }
     }
-    while (v.size() > 1)
+
+    vector<AgglomerativeNode> tree = agglomerate(boxes, counts);
+    if (tree.empty())
+        return NULL;
+    agglomerative_nodes = arena->allocate<KBVHNode>(tree.size());
+    for (size_t i = 0; i < tree.size(); ++i)
     {
-        // sah代价最小
-        double minCost = numeric_limits<double>::max();
-        size_t left, right;
-        for (size_t i = 0; i < v.size(); ++i)
-            for (size_t j = 0; j < v.size(); ++j)
-            {
-                if (i == j)
-                    continue;
-                // sa*na+sb*nb
-                double cost = v[i]->c.indexOfPrimitives.size() * v[i]->bb.surface_area() + v[j]->c.indexOfPrimitives.size() * v[j]->bb.surface_area();
-                if (cost < minCost)
-                {
-                    minCost = cost;
-                    left = i;
-                    right = j;
-                }
-            }
-        if (left > right)
+        new (&agglomerative_nodes[i]) KBVHNode(tree[i].bb, tree[i].count);
+        if (tree[i].isLeaf())
         {
-            size_t temp = left;
-            left = right;
-            right = temp;
+            agglomerative_nodes[i].begin = cluster[leaf_cluster[i]].begin;
+            agglomerative_nodes[i].end = cluster[leaf_cluster[i]].end;
+        }
+        else
+        {
+            agglomerative_nodes[i].l = &agglomerative_nodes[tree[i].left];
+            agglomerative_nodes[i].r = &agglomerative_nodes[tree[i].right];
         }
-
-        KBVHNode *newNode = combine(v[left], v[right]);
-        v.erase(v.begin() + left);
-        v.erase(v.begin() + right - 1);
-        v.push_back(newNode);
     }
-    return v[0];
+    return &agglomerative_nodes[tree.size() - 1];
 }
 
-KBVHNode *Kmeans::combine(KBVHNode *a, KBVHNode *b)
-{
-    Cluster c;
-    BoundingBox bb;
-    for (size_t i = 0; i < a->c.indexOfPrimitives.size(); ++i)
-    {
-        c.indexOfPrimitives.push_back(a->c.indexOfPrimitives[i]);
-        bb.expand(primitives[a->c.indexOfPrimitives[i]]->get_bbox());
-    }
+// K在编译期已知时使用定长数组, 否则 (K == 0) 使用运行期长度的vector
+template <typename T, size_t K>
+struct ClusterLocal {
+    std::array<T, K> v;
+    explicit ClusterLocal(size_t) { }
+    T& operator[](size_t i) { return v[i]; }
+};
 
-    for (size_t i = 0; i < b->c.indexOfPrimitives.size(); ++i)
-    {
-        c.indexOfPrimitives.push_back(b->c.indexOfPrimitives[i]);
-        bb.expand(primitives[b->c.indexOfPrimitives[i]]->get_bbox());
+template <typename T>
+struct ClusterLocal<T, 0> {
+    std::vector<T> v;
+    explicit ClusterLocal(size_t k) : v(k) { }
+    T& operator[](size_t i) { return v[i]; }
+};
+
+Kmeans::AssignKernel Kmeans::assignKernel(size_t K)
+{
+    switch (K) {
+    case 2:
+        return &Kmeans::assign<2>;
+    case 4:
+        return &Kmeans::assign<4>;
+    case 8:
+        return &Kmeans::assign<8>;
+    case 16:
+        return &Kmeans::assign<16>;
+    default:
+        return &Kmeans::assign<0>;
     }
-    KBVHNode *res = new KBVHNode(bb, c);
-    res->l = a;
-    res->r = b;
-    return res;
 }
 
-#define RUN_OPENMP
 void Kmeans::run()
 {
-    int total_size = primitives.size();
+    // 大节点只在分层采样上迭代求质心, 最后对全部图元做一次分配
+    PrimitiveBounds sample;
+    const bool sampled = sampleStratified(sample);
+    PrimitiveBounds &store = sampled ? sample : *bounds;
+    const size_t begin = sampled ? 0 : m_begin;
+    const size_t end = sampled ? sample.size() : m_end;
+
+    const size_t total_size = end - begin;
+    initCentroids(store, begin, end);
+    iterations_used = 0;
     for (size_t iter = 0; iter < m_iterations; ++iter) {
         for (size_t i = 0; i < m_K; ++i) {
             if (iter != 0) {
                 cluster[i].updateRepresentive();
             }
+        }
+        if (iter != 0) {
+            reseedEmptyClusters(store, begin, end);
+        }
+        for (size_t i = 0; i < m_K; ++i) {
             cluster[i].reset();
-            cluster[i].indexOfPrimitives.clear();
-        }
-
-        #ifdef RUN_OPENMP // run in parallel
-        #define MP_THREAD_NUM 8
-        // Method 2
-        if(total_size > 1024) {
-            std::array<std::vector<size_t>, 8> local_clusters_indexes;
-            std::array<glm::vec3, 8> local_clusters_mmin;
-            std::array<glm::vec3, 8> local_clusters_mmax;
-            // spawn thread
-            #pragma omp parallel num_threads(MP_THREAD_NUM) \
-                shared(cluster, primitives, total_size) \
-                private(local_clusters_indexes, local_clusters_mmin, local_clusters_mmax)
-            {
-                // init local array
-                for(int c = 0; c < 8; ++c) {
-                    local_clusters_mmin[c] = glm::vec3(0.0f);
-                    local_clusters_mmax[c] = glm::vec3(0.0f);
-                    local_clusters_indexes[c].reserve(total_size >> 2);
-                }
+        }
+        // 第一次分配前的label属于父节点, 不统计变化
+        size_t changed = (this->*m_assign)(store, begin, end, iter != 0);
+        ++iterations_used;
 
-                // staticallly partitioning blocks
-                #pragma omp for schedule(static)
-                for (int primitive_idx = 0; primitive_idx < total_size; ++primitive_idx) {
-                    BoundingBox primitive_bbox = primitives[primitive_idx]->get_bbox();
-                    double distances[8];
-
-                    // SIMD computation for distance
-                    #pragma omp simd
-                    for (int c = 0; c < 8; ++c) {
-                        BoundingBox cluster_bbox = cluster[c].representive;
-                        double min_value = glm::length(primitive_bbox.min - cluster_bbox.min);
-                        double max_value = glm::length(primitive_bbox.max - cluster_bbox.max);
-                        distances[c] = min_value + max_value;
-                    }
+        // 没有图元改变cluster时再迭代结果也不会变化; 否则按阈值提前结束
+        if (iter != 0 && (changed == 0 || changed < m_convergence * total_size)) {
+            break;
+        }
+    }
 
-                    // find nearest cluster in serial
-                    int nearest = 0;
-                    double min_dist = distances[0];
-                    for (int c = 1; c < 8; ++c) {
-                        if (distances[c] < min_dist) {
-                            min_dist = distances[c];
-                            nearest = c;
-                        }
-                    }
+    if (sampled) {
+        for (size_t i = 0; i < m_K; ++i) {
+            cluster[i].updateRepresentive();
+        }
+        reseedEmptyClusters(store, begin, end);
+        for (size_t i = 0; i < m_K; ++i) {
+            cluster[i].reset();
+        }
+        (this->*m_assign)(*bounds, m_begin, m_end, false);
+        ++iterations_used;
+    }
+    // 剪枝用的上下界只在本节点的迭代中有效
+    std::vector<float>().swap(m_upper);
+    std::vector<float>().swap(m_lower);
+    // print();
+}
 
-                    // update local cluster data
-                    local_clusters_mmin[nearest] += primitive_bbox.min;
-                    local_clusters_mmax[nearest] += primitive_bbox.max;
-                    local_clusters_indexes[nearest].push_back(primitive_idx);
-                }
+bool Kmeans::sampleStratified(PrimitiveBounds& sample)
+{
+    const size_t total_size = m_end - m_begin;
+    if (m_sampleThreshold == 0 || total_size <= m_sampleThreshold) {
+        return false;
+    }
+    // m_sampleSize不大于1时表示占本节点图元数的比例
+    size_t count = m_sampleSize <= 1.0 ? (size_t)(m_sampleSize * total_size) : (size_t)m_sampleSize;
+    if (count < m_K || count >= total_size) {
+        return false;
+    }
 
-                // merge local cluster data to global
-                #pragma omp critical
-                {
-                    for (int c = 0; c < 8; ++c) {
-                        cluster[c].m_min += local_clusters_mmin[c];
-                        cluster[c].m_max += local_clusters_mmax[c];
-
-                        cluster[c].indexOfPrimitives.insert(
-                            cluster[c].indexOfPrimitives.end(),
-                            local_clusters_indexes[c].begin(),
-                            local_clusters_indexes[c].end()
-                        );
-                    }
-                }
+    // 把区间均分为count层, 每层随机取一个图元
+    CounterRng rng(m_seed, ~m_path);
+    sample.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        const size_t stratum_begin = i * total_size / count;
+        const size_t stratum_end = (i + 1) * total_size / count;
+        sample.copy(i, *bounds, m_begin + stratum_begin + rng.uniform(stratum_end - stratum_begin));
+    }
+    return true;
+}
+
+#define RUN_OPENMP
+template <size_t K>
+size_t Kmeans::assign(PrimitiveBounds& store, size_t begin, size_t end, bool count_changes)
+{
+    const int total_size = (end - begin);
+    const size_t k = K > 0 ? K : m_K;
+
+    // 当前representive转为SoA, 供SIMD kernel广播
+    ClusterLocal<float, 6 * K> centroids(6 * k);
+    for (size_t c = 0; c < k; ++c) {
+        const BoundingBox &representive = cluster[c].representive;
+        centroids[c] = representive.min.x;
+        centroids[k + c] = representive.min.y;
+        centroids[2 * k + c] = representive.min.z;
+        centroids[3 * k + c] = representive.max.x;
+        centroids[4 * k + c] = representive.max.y;
+        centroids[5 * k + c] = representive.max.z;
+    }
+    const float *centroid_data = &centroids[0];
+    // 按CPU支持的指令集选择kernel, 结果写入store.label
+    const kernel::NearestKernel nearest = kernel::nearest_kernel<K>(kernel::active_isa());
+    const uint8_t *label = store.label.data();
+
+    // Hamerly剪枝: 本次分配前更新每个图元的上下界, 首次分配时初始化
+    const bool pruned = m_pruning;
+    std::vector<float> drift, half_gap;
+    float max_drift = 0.0f, second_drift = 0.0f;
+    if (pruned) {
+        preparePruning(centroid_data, k, total_size, count_changes, drift, half_gap, max_drift, second_drift);
+    }
+
+    // 质心的部分和按块 (assignBlockSize) 求出, 再按块的顺序归约,
+    // 浮点求和顺序与线程数和构造模式无关, 保证同一种子下构造结果可复现
+    const int block_count = (total_size + assignBlockSize - 1) / assignBlockSize;
+    std::vector<glm::vec3> block_mmin(block_count * k, glm::vec3(0.0f));
+    std::vector<glm::vec3> block_mmax(block_count * k, glm::vec3(0.0f));
+    auto block_range = [&](int block) {
+        const size_t block_begin = begin + (size_t)block * assignBlockSize;
+        return std::make_pair(block_begin, std::min(block_begin + assignBlockSize, end));
+    };
+    // 每块中改变了所属cluster的图元数, 以及每块中各cluster的图元数
+    std::vector<size_t> block_changed(block_count, 0);
+    std::vector<uint32_t> block_members(block_count * k, 0);
+    // 剪枝模式下每块实际计算的距离次数
+    std::vector<size_t> block_evaluations(block_count, 0);
+    // 对一个块执行kernel, 统计变化并累加部分和
+    auto assign_block = [&](int block) {
+        const auto range = block_range(block);
+        uint8_t previous[assignBlockSize];
+        if (count_changes) {
+            std::copy(label + range.first, label + range.second, previous);
+        }
+        if (pruned) {
+            block_evaluations[block] = assignPruned(store, range.first, range.first - begin, range.second - range.first,
+                                                    centroid_data, k, count_changes, drift.data(), half_gap.data(),
+                                                    max_drift, second_drift);
+        } else {
+            nearest(store, range.first, range.second, centroid_data, k);
+        }
+
+        glm::vec3 *mmin = &block_mmin[block * k];
+        glm::vec3 *mmax = &block_mmax[block * k];
+        uint32_t *members = &block_members[block * k];
+        size_t changed = 0;
+        for (size_t id = range.first; id < range.second; ++id) {
+            mmin[label[id]] += store.min(id);
+            mmax[label[id]] += store.max(id);
+            ++members[label[id]];
+            changed += count_changes && previous[id - range.first] != label[id];
+        }
+        block_changed[block] = count_changes ? changed : range.second - range.first;
+    };
+
+    #ifdef RUN_OPENMP // run in parallel
+    // Method 2: 只写每个图元的label, 各cluster的图元在最后一次迭代后由partition()一次性排序
+    if(total_size > assignBlockSize && !task_parallel) {
+        // staticallly partitioning blocks
+        #pragma omp parallel for schedule(static)
+        for (int block = 0; block < block_count; ++block) {
+            assign_block(block);
+        }
+    }
+    // Method 3: 任务模式下的大节点, 已处于omp parallel区域内,
+    // 用taskloop做数据并行, 空闲线程可以同时窃取其他子树的task
+    else if(total_size > assignBlockSize) {
+        #pragma omp taskloop grainsize(1) default(shared)
+        for (int block = 0; block < block_count; ++block) {
+            assign_block(block);
+        }
+    }
+    // 小节点 (Method 1) 和任务模式下的小节点: 一个块, 串行计算即可
+    else
+    #endif
+    {
+        for (int block = 0; block < block_count; ++block) {
+            assign_block(block);
+        }
+    }
+
+    size_t changed = 0;
+    for (int block = 0; block < block_count; ++block) {
+        for (size_t c = 0; c < k; ++c) {
+            cluster[c].m_min += block_mmin[block * k + c];
+            cluster[c].m_max += block_mmax[block * k + c];
+            cluster[c].count += block_members[block * k + c];
+        }
+        changed += block_changed[block];
+    }
+    if (pruned) {
+        size_t evaluations = 0;
+        for (int block = 0; block < block_count; ++block) {
+            evaluations += block_evaluations[block];
+        }
+        distance_evaluations += evaluations;
+        distance_avoided += (uint64_t)total_size * k - evaluations;
+    }
+    return changed;
+}
+
+// 剪枝判定留出的相对余量: 界由不同舍入方式 (FMA/非FMA) 的距离累加而来,
+// 距离几乎相等时交给完整搜索, 保证与不剪枝的结果一致 (相同距离取下标较小者)
+#define pruneSlack 1.0001f
+
+// Making k-means even faster (Hamerly 2010)
+// 距离 |p.min - c.min| + |p.max - c.max| 是两个欧氏距离之和, 满足三角不等式:
+// upper为到所属centroid距离的上界, lower为到其他centroid距离的下界,
+// centroid移动后上界加上所属centroid的位移, 下界减去其他centroid的最大位移;
+// upper不超过max(lower, 所属centroid到最近centroid距离的一半)时最近的centroid不变
+static inline float centroid_distance(const float *centroids, size_t k, size_t a, size_t b)
+{
+    const glm::vec3 dmin(centroids[a] - centroids[b], centroids[k + a] - centroids[k + b],
+                         centroids[2 * k + a] - centroids[2 * k + b]);
+    const glm::vec3 dmax(centroids[3 * k + a] - centroids[3 * k + b], centroids[4 * k + a] - centroids[4 * k + b],
+                         centroids[5 * k + a] - centroids[5 * k + b]);
+    return glm::length(dmin) + glm::length(dmax);
+}
+
+static inline float primitive_distance(const PrimitiveBounds& store, size_t slot, const float *centroids, size_t k, size_t c)
+{
+    const glm::vec3 dmin(store.minX[slot] - centroids[c], store.minY[slot] - centroids[k + c],
+                         store.minZ[slot] - centroids[2 * k + c]);
+    const glm::vec3 dmax(store.maxX[slot] - centroids[3 * k + c], store.maxY[slot] - centroids[4 * k + c],
+                         store.maxZ[slot] - centroids[5 * k + c]);
+    return glm::length(dmin) + glm::length(dmax);
+}
+
+void Kmeans::preparePruning(const float *centroids, size_t k, size_t total_size, bool update,
+                            std::vector<float>& drift, std::vector<float>& half_gap,
+                            float& max_drift, float& second_drift)
+{
+    // 各centroid的位移, 以及最大和第二大的位移 (所属centroid本身位移最大时用第二大的)
+    drift.assign(k, 0.0f);
+    if (update) {
+        for (size_t c = 0; c < k; ++c) {
+            const glm::vec3 dmin(centroids[c] - m_previous[c], centroids[k + c] - m_previous[k + c],
+                                 centroids[2 * k + c] - m_previous[2 * k + c]);
+            const glm::vec3 dmax(centroids[3 * k + c] - m_previous[3 * k + c], centroids[4 * k + c] - m_previous[4 * k + c],
+                                 centroids[5 * k + c] - m_previous[5 * k + c]);
+            drift[c] = glm::length(dmin) + glm::length(dmax);
+            if (drift[c] > max_drift) {
+                second_drift = max_drift;
+                max_drift = drift[c];
+            } else if (drift[c] > second_drift) {
+                second_drift = drift[c];
             }
         }
-        // Method 1
-        else {
-            std::vector<int> nearestCluster(total_size);
-            #pragma omp parallel for
-            for (int idx_primitives = 0; idx_primitives < total_size; ++idx_primitives) {
-                int index = 0;
-                double minDistance = std::numeric_limits<double>::max();
-                BoundingBox temp = primitives[idx_primitives]->get_bbox();
-                for (int idx_clusters = 0; idx_clusters < m_K; ++idx_clusters) {
-                    double dist = calDistance(temp, cluster[idx_clusters].representive);
-                    if (dist < minDistance) {
-                        minDistance = dist;
-                        index = idx_clusters;
-                    }
-                }
-                nearestCluster[idx_primitives] = index;
+    } else {
+        m_upper.resize(total_size);
+        m_lower.resize(total_size);
+    }
+    m_previous.assign(centroids, centroids + 6 * k);
+
+    half_gap.assign(k, INF_F);
+    for (size_t a = 0; a < k; ++a) {
+        for (size_t b = a + 1; b < k; ++b) {
+            const float gap = 0.5f * centroid_distance(centroids, k, a, b);
+            half_gap[a] = std::min(half_gap[a], gap);
+            half_gap[b] = std::min(half_gap[b], gap);
+        }
+    }
+}
+
+size_t Kmeans::assignPruned(PrimitiveBounds& store, size_t slot_begin, size_t local_begin, size_t count,
+                            const float *centroids, size_t k, bool update, const float *drift, const float *half_gap,
+                            float max_drift, float second_drift)
+{
+    uint8_t *label = store.label.data();
+    float *upper = m_upper.data() + local_begin;
+    float *lower = m_lower.data() + local_begin;
+    size_t evaluations = 0;
+
+    // 界无法排除的槽位收集起来, 一次交给SIMD kernel完整搜索最近和次近的centroid
+    uint32_t slots[assignBlockSize];
+    size_t pending = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const size_t slot = slot_begin + i;
+        if (update) {
+            const uint8_t a = label[slot];
+            upper[i] += drift[a];
+            lower[i] -= drift[a] == max_drift ? second_drift : max_drift;
+            const float bound = std::max(lower[i], half_gap[a]);
+            if (upper[i] * pruneSlack < bound) {
+                continue;
             }
-            for (size_t idx_primitives = 0; idx_primitives < primitives.size(); ++idx_primitives) {
-                size_t index = nearestCluster[idx_primitives];
-                cluster[index].add(idx_primitives, primitives[idx_primitives]->get_bbox());
+            // 收紧上界后再判断一次
+            upper[i] = primitive_distance(store, slot, centroids, k, a);
+            ++evaluations;
+            if (upper[i] * pruneSlack < bound) {
+                continue;
             }
         }
+        slots[pending++] = static_cast<uint32_t>(slot);
+    }
 
-        #else // run in serial
-        for (size_t idx_primitives = 0; idx_primitives < primitives.size(); ++idx_primitives) {
-            size_t index = 0;
-            double minDistance = numeric_limits<double>::max();
-            BoundingBox temp = primitives[idx_primitives]->get_bbox();
-            for (size_t idx_clusters = 0; idx_clusters < m_K; ++idx_clusters) {
-                double dist = calDistance(temp, cluster[idx_clusters].representive);
-                if (dist < minDistance) {
-                    minDistance = dist;
-                    index = idx_clusters;
-                }
+    if (pending > 0) {
+        uint8_t nearest[assignBlockSize];
+        float best[assignBlockSize], second[assignBlockSize];
+        kernel::bounded_kernel(kernel::active_isa())(store, slots, pending, centroids, k, nearest, best, second);
+        for (size_t t = 0; t < pending; ++t) {
+            const size_t i = slots[t] - slot_begin;
+            label[slots[t]] = nearest[t];
+            upper[i] = best[t];
+            lower[i] = second[t];
+        }
+        evaluations += pending * k;
+    }
+    return evaluations;
+}
+
+void Kmeans::reseedEmptyClusters(PrimitiveBounds &store, size_t begin, size_t end)
+{
+    const uint8_t *label = store.label.data();
+    for (size_t c = 0; c < m_K; ++c)
+    {
+        if (cluster[c].count > 0)
+            continue;
+        size_t largest = 0;
+        for (size_t i = 1; i < m_K; ++i)
+        {
+            if (cluster[i].count > cluster[largest].count)
+                largest = i;
+        }
+        if (cluster[largest].count < 2)
+            return;
+
+        // 被选中的图元移入空cluster, 避免下一个空cluster选到同一个图元
+        size_t farthest = begin;
+        float max_distance = -1.0f;
+        for (size_t slot = begin; slot < end; ++slot)
+        {
+            if (label[slot] != largest)
+                continue;
+            const float distance = seed_distance(store, slot, cluster[largest].representive);
+            if (distance > max_distance)
+            {
+                max_distance = distance;
+                farthest = slot;
             }
-            cluster[index].add(idx_primitives, primitives[idx_primitives]->get_bbox());
         }
-        #endif
+        cluster[c].representive = store.get_bbox(farthest);
+        store.label[farthest] = static_cast<uint8_t>(c);
+        // 剪枝模式下该图元的上界不再对应它所属的centroid, 下次分配时重新计算
+        if (m_pruning)
+            m_upper[farthest - begin] = INF_F;
+        --cluster[largest].count;
+        ++cluster[c].count;
+    }
+}
+
+void Kmeans::medianSplit()
+{
+    median_split = true;
+    const size_t total_size = m_end - m_begin;
+    const int axis = world.max_dimension();
+
+    // 稳定排序, 中心相同的图元保持原来的顺序, 结果可复现
+    std::vector<float> key(total_size);
+    std::vector<uint32_t> order(total_size);
+    for (size_t i = 0; i < total_size; ++i)
+    {
+        key[i] = bounds->min(m_begin + i)[axis] + bounds->max(m_begin + i)[axis];
+        order[i] = (uint32_t)i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return key[a] < key[b]; });
+
+    PrimitiveBounds sorted;
+    sorted.resize(total_size);
+    for (size_t i = 0; i < total_size; ++i)
+        sorted.copy(i, *bounds, m_begin + order[i]);
+    for (size_t i = 0; i < total_size; ++i)
+        bounds->copy(m_begin + i, sorted, i);
+
+    const size_t parts = std::min(m_K, total_size);
+    for (size_t c = 0; c < m_K; ++c)
+    {
+        cluster[c].begin = m_begin + (c < parts ? c * total_size / parts : total_size);
+        cluster[c].end = m_begin + (c < parts ? (c + 1) * total_size / parts : total_size);
+        cluster[c].count = cluster[c].size();
+        BoundingBox cluster_world;
+        for (size_t slot = cluster[c].begin; slot < cluster[c].end; ++slot)
+            cluster_world.expand(bounds->get_bbox(slot));
+        cluster[c].world = cluster_world;
+    }
+}
+
+size_t Kmeans::medianSplits() const
+{
+    size_t count = median_split ? 1 : 0;
+    for (size_t i = 0; i < m_K; ++i)
+    {
+        if (const Kmeans *c = child(i))
+            count += c->medianSplits();
+    }
+    return count;
+}
+
+void Kmeans::iterationStats(size_t& iterations, size_t& nodes) const
+{
+    iterations += iterations_used;
+    ++nodes;
+    for (size_t i = 0; i < m_K; ++i)
+    {
+        if (const Kmeans *c = child(i))
+            c->iterationStats(iterations, nodes);
+    }
+}
+
+void Kmeans::pruningStats(uint64_t& evaluations, uint64_t& avoided) const
+{
+    evaluations += distance_evaluations;
+    avoided += distance_avoided;
+    for (size_t i = 0; i < m_K; ++i)
+    {
+        if (const Kmeans *c = child(i))
+            c->pruningStats(evaluations, avoided);
     }
-    // print();
 }
 
 // void Kmeans::traverse_cluster(std::vector<float> *vertices, std::vector<float> *colors, std::vector<int> *indices) const {
@@ -397,7 +1168,7 @@ void Kmeans::print() const
     cout << "**********************************" << endl;
     for (size_t i = 0; i < m_K; ++i)
     {
-        cout << "#" << i << " Cluster: " << cluster[i].indexOfPrimitives.size() << endl;
+        cout << "#" << i << " Cluster: " << cluster[i].size() << endl;
     }
     cout << "**********************************" << endl;
     cout << endl;
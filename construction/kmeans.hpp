@@ -1,20 +1,36 @@
+#ifndef KMEANS_H_
+#define KMEANS_H_
+
 #include "bbox.hpp"
 #include "cluster.hpp"
 #include "primitive.h"
+#include "primitive_bounds.hpp"
+#include "agglomerative.hpp"
+#include "arena.hpp"
+#include <cstdint>
 #include <functional>
 
 struct KBVHNode {
 public:
     BoundingBox bb;
-    Cluster c;
+    // 子树中的图元数
+    uint32_t count;
+    // 叶子节点 (一个cluster) 在PrimitiveBounds中的槽位区间, 内部节点不保存图元
+    size_t begin;
+    size_t end;
     KBVHNode* l;
     KBVHNode* r;
 
     inline bool isLeaf() const { return l == NULL && r == NULL; }
 
-    KBVHNode(BoundingBox bb, Cluster c)
+    // 子树未归一化的SAH代价: 内部节点面积 * traversal + 叶子面积 * 图元数 * intersection
+    double sahCost(float traversal, float intersection) const;
+
+    KBVHNode(BoundingBox bb, uint32_t count)
         : bb(bb)
-        , c(c)
+        , count(count)
+        , begin(0)
+        , end(0)
         , l(NULL)
         , r(NULL)
     {
@@ -23,14 +39,43 @@ public:
 
 class Kmeans {
 public:
+    // 初始centroid的选取方式
+    // Heuristic: 每次随机P个图元, 取离已选centroid最远的一个 (原始做法)
+    // PlusPlus: k-means++, 按到最近已选centroid距离的平方 (D²) 加权抽样
+    // Parallel: k-means||, 每轮按D²独立地过采样约2K个候选, 再在加权的候选上做k-means++
+    enum class Seeding {
+        Heuristic,
+        PlusPlus,
+        Parallel,
+    };
+
+    // 叶子判定: 默认图元数少于 maxLeafNum * K (指定max_leaf时为不超过max_leaf) 的cluster为叶子
+    // sah为true时每个节点聚类后比较作为叶子与划分一层的SAH代价, 划分不划算时退化为叶子;
+    // 图元数超过max_leaf (0表示 maxLeafNum * K) 的节点总是继续划分
+    struct LeafPolicy {
+        bool sah = false;
+        float traversal = 1.0f;
+        float intersection = 1.0f;
+        size_t max_leaf = 0;
+    };
+
     Kmeans()
     {
         cluster = NULL;
         children = NULL;
+        root = NULL;
+        agglomerative_nodes = NULL;
+        arena = NULL;
     }
 
-    Kmeans(size_t iterCount, size_t K, size_t P, std::vector<Primitive *> primitives);
-    ~Kmeans();
+    // 节点自身、cluster、子节点及凝聚聚类的节点都分配在arena中, 随arena一起释放
+    Kmeans(size_t iterCount, size_t K, size_t P, PrimitiveBounds *bounds, Arena *arena, size_t begin, size_t end,
+           uint64_t seed = 0, uint64_t path = 0);
+
+    // 一次分配: 把本节点的图元分配到最近的cluster, 返回改变了cluster的图元数
+    typedef size_t (Kmeans::*AssignKernel)(PrimitiveBounds& store, size_t begin, size_t end, bool count_changes);
+    // 按K选择编译期特化的分配kernel (2/4/8/16), 其他K使用运行期循环
+    static AssignKernel assignKernel(size_t K);
 
     // 执行
     void run();
@@ -38,23 +83,64 @@ public:
     // 注册与渲染沟通的callback
     void registerCallback(std::function<void (const BoundingBox, const bool)> func);
 
+    // 开启子树任务并行构造 (需在omp parallel区域内调用constructKaryTree)
+    void setTaskParallel(bool enable) { task_parallel = enable; }
+
+    // 改变cluster的图元比例低于threshold时提前结束迭代 (0: 只在完全收敛时提前结束)
+    void setConvergence(float threshold) { m_convergence = threshold; }
+
+    // 图元数超过threshold的节点在采样上迭代, size不大于1时为采样比例, 否则为采样个数 (threshold为0时关闭)
+    void setSampling(size_t threshold, double size)
+    {
+        m_sampleThreshold = threshold;
+        m_sampleSize = size;
+    }
+
+    // 以三角不等式维护每个图元的距离上下界, 跳过不可能改变最近centroid的距离计算 (Hamerly), 适合较大的K
+    void setPruning(bool enable) { m_pruning = enable; }
+
+    void setSeeding(Seeding seeding) { m_seeding = seeding; }
+
+    void setLeafPolicy(const LeafPolicy& policy) { m_leafPolicy = policy; }
+
+    // 累加子树中执行的k-means迭代次数与节点数
+    void iterationStats(size_t& iterations, size_t& nodes) const;
+
+    // 子树中聚类失败 (全部图元落入同一个cluster) 而改用中位数划分的节点数
+    size_t medianSplits() const;
+
+    // 累加子树中剪枝模式下实际计算与跳过的图元-centroid距离次数
+    void pruningStats(uint64_t& evaluations, uint64_t& avoided) const;
+
     // 从上至下构造k叉树
     void constructKaryTree(int depth);
 
+    // cluster i 的子节点, 叶子cluster返回NULL
+    const Kmeans* child(size_t i) const { return children_existence[i] ? children[i] : NULL; }
+
     // 从下至上 凝聚聚类(AC)构造二叉树
     KBVHNode* agglomerativeClustering();
 
-    // 自底向上递归构造
+    // 自底向上构造: 每层凝聚聚类, 再把子节点的二叉树接到对应的叶子上
+    // 构造完成后root为整棵子树的二叉BVH, 任务模式下兄弟子树并行细化
     void buttom2Top();
 
+    // k叉树未归一化的SAH代价, 同KBVHNode::sahCost
+    double sahCost(float traversal, float intersection) const;
+
     // 打印结果
     void print() const;
 
     // 传递当前的cluster内容到外部数组中, 但不修改当前内容
     void traverse_cluster(std::vector<float> *vertices, std::vector<float> *colors, std::vector<int> *indices) const;
 
-    // 迭代次数
+    // 迭代次数 (上限)
     size_t m_iterations;
+    // 实际执行的迭代次数
+    size_t iterations_used;
+    // 剪枝模式下本节点实际计算与跳过的距离次数
+    uint64_t distance_evaluations;
+    uint64_t distance_avoided;
     // 参数K
     size_t m_K;
     // 参数P
@@ -62,6 +148,10 @@ public:
 
     int unique_id;
 
+    // 随机种子 (整棵树共享) 与本节点在树中的路径, 决定本节点的随机序列
+    uint64_t m_seed;
+    uint64_t m_path;
+
     // 聚类体
     Cluster* cluster;
 
@@ -72,22 +162,76 @@ public:
 
     // 本层构造出的二叉树根节点（只有用agglomerative算法时会用到）
     KBVHNode* root;
+    // root所在的节点数组 (arena中)
+    KBVHNode* agglomerative_nodes;
+
+    // 本次构造的分配器 (BVHBuilder持有)
+    Arena *arena;
 
-    // 输入数据
-    std::vector<Primitive *> primitives;
+    // 所有图元的包围盒 (BVHBuilder持有, 所有节点共享)
+    PrimitiveBounds *bounds;
+
+    // 输入数据: 本节点在bounds中拥有的槽位区间[m_begin, m_end)
+    size_t m_begin;
+    size_t m_end;
 
 private:
     // 计时用
     // Timer timer;
 
     std::vector<bool> children_existence;
+    // 子树以OpenMP task并行构造
+    bool task_parallel = false;
     // 与渲染进行沟通的callback
     std::function<void (const BoundingBox, const bool)> callback_func;
 
-    // 初始化随机点
-    std::vector<BoundingBox> getRandCentroidsOnMesh(int k, int p);
-    // 距离公式
-    float calDistance(BoundingBox b1, BoundingBox b2);
-    // 合并两个KBVHNode (agglomerativeClustering用)
-    KBVHNode* combine(KBVHNode* a, KBVHNode* b);
-};
\ No newline at end of file
+    // 在store的[begin, end)上初始化随机点 (heuristic)
+    std::vector<BoundingBox> getRandCentroidsOnMesh(PrimitiveBounds& store, size_t begin, size_t end, int k, int p);
+    Seeding m_seeding;
+    // 按m_seeding在store的[begin, end)上选取初始centroid
+    void initCentroids(PrimitiveBounds& store, size_t begin, size_t end);
+    std::vector<BoundingBox> seedPlusPlus(PrimitiveBounds& store, size_t begin, size_t end);
+    std::vector<BoundingBox> seedParallel(PrimitiveBounds& store, size_t begin, size_t end);
+    // 分配kernel, K == 0 时使用运行期的m_K
+    // 对store中的[begin, end)执行一次分配
+    template <size_t K>
+    size_t assign(PrimitiveBounds& store, size_t begin, size_t end, bool count_changes);
+    AssignKernel m_assign;
+    // 提前结束迭代的阈值
+    float m_convergence;
+
+    // Hamerly剪枝: 每个图元的上下界 (本节点分配区间的局部下标) 与上一次分配时的centroid (SoA)
+    bool m_pruning;
+    std::vector<float> m_upper;
+    std::vector<float> m_lower;
+    std::vector<float> m_previous;
+    // 求centroid的位移和到最近centroid距离的一半, 首次分配 (update为false) 时分配上下界
+    void preparePruning(const float *centroids, size_t k, size_t total_size, bool update,
+                        std::vector<float>& drift, std::vector<float>& half_gap,
+                        float& max_drift, float& second_drift);
+    // 对store中的[slot_begin, slot_begin + count)做剪枝分配, 返回实际计算的距离次数
+    size_t assignPruned(PrimitiveBounds& store, size_t slot_begin, size_t local_begin, size_t count,
+                        const float *centroids, size_t k, bool update, const float *drift, const float *half_gap,
+                        float max_drift, float second_drift);
+
+    // 大节点的分层采样, 不需要采样时返回false
+    bool sampleStratified(PrimitiveBounds& sample);
+    size_t m_sampleThreshold;
+    double m_sampleSize;
+    // 按cluster原地重排本节点的槽位区间, 每个cluster占据连续的子区间
+    void partition();
+
+    // 空cluster的中心点取最大cluster中离其中心点最远的图元
+    void reseedEmptyClusters(PrimitiveBounds& store, size_t begin, size_t end);
+    // 聚类没有缩小图元集合时, 沿包围盒最长轴按图元中心排序, 等分为K段
+    bool median_split;
+    void medianSplit();
+
+    LeafPolicy m_leafPolicy;
+    // 按SAH判定为叶子的节点 (由父节点在taskwait之后改为叶子cluster)
+    bool collapsed;
+    size_t maxLeafSize() const;
+    // 图元数为n的cluster是否直接作为叶子
+    bool isLeafCluster(size_t n) const;
+};
+#endif // KMEANS_H_
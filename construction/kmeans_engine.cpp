@@ -0,0 +1,151 @@
+#include "kmeans_engine.hpp"
+#include "build_options.hpp"
+#include "kmeans.hpp"
+#include "nearest_kernel.hpp"
+#include "timer.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <omp.h>
+
+void KmeansEngine::prepare(const TriangleMesh& mesh, PrimitiveBounds& bounds)
+{
+    const BuildOptions& options = BuildOptions::global();
+
+    // 选择最近centroid kernel的指令集
+    if (!options.isa.empty()) {
+        kernel::Isa isa;
+        if (kernel::parse_isa(options.isa.c_str(), isa)) {
+            kernel::set_active_isa(isa);
+        } else {
+            std::cerr << "[WARNING] Unknown --isa '" << options.isa << "', available: scalar, avx2, avx512" << std::endl;
+        }
+    }
+    std::cout << "[Log] Nearest-centroid kernel: " << kernel::isa_name(kernel::active_isa()) << std::endl;
+    if (options.bench_kernel) {
+        kernel::benchmark(bounds, options.k);
+    }
+
+    m_leafPolicy.sah = options.sah_leaf;
+    m_leafPolicy.traversal = options.traversal_cost;
+    m_leafPolicy.intersection = options.intersection_cost;
+    m_leafPolicy.max_leaf = options.max_leaf;
+
+    // 初始centroid的选取方式
+    m_seeding = Kmeans::Seeding::Heuristic;
+    if (options.seeding == "kmeans++") {
+        m_seeding = Kmeans::Seeding::PlusPlus;
+    } else if (options.seeding == "kmeans||") {
+        m_seeding = Kmeans::Seeding::Parallel;
+    } else if (!options.seeding.empty() && options.seeding != "heuristic") {
+        std::cerr << "[WARNING] Unknown --seeding '" << options.seeding << "', available: heuristic, kmeans++, kmeans||" << std::endl;
+    }
+
+    // 参照: 原始的串行递归构造, 不通知visualization
+    m_referenceUs = 0;
+    if (options.compare) {
+        timer::create_k_means_header();
+        auto start_time = std::chrono::high_resolution_clock::now();
+        Arena reference_arena;
+        Kmeans *reference = createRoot(mesh, bounds, reference_arena);
+        reference->constructKaryTree(0);
+        auto end_time = std::chrono::high_resolution_clock::now();
+        m_referenceUs = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
+        std::cout << "[Log] Reference (serial recursion) K-means BVH Building: " << m_referenceUs << " us" << std::endl;
+        // 恢复被重排的图元顺序
+        bounds.build(mesh);
+    }
+}
+
+Kmeans* KmeansEngine::createRoot(const TriangleMesh& mesh, PrimitiveBounds& bounds, Arena& arena) const
+{
+    const BuildOptions& options = BuildOptions::global();
+    Kmeans *k = arena.create<Kmeans>(options.max_iterations(), options.k, 5, &bounds, &arena, 0, mesh.size(), options.seed);
+    k->setConvergence(options.converge);
+    k->setSampling(options.sample_threshold, options.sample_size);
+    k->setPruning(options.prune);
+    k->setSeeding(m_seeding);
+    k->setLeafPolicy(m_leafPolicy);
+    return k;
+}
+
+void KmeansEngine::build(const TriangleMesh& mesh, PrimitiveBounds& bounds, Arena& arena, LinearBVH& bvh)
+{
+    const BuildOptions& options = BuildOptions::global();
+
+    // 创建表头, 参照构造的行不计入统计
+    timer::create_k_means_header();
+
+    std::cout << "[Log] K-means BVH Building... (seed " << options.seed << ")" << std::endl;
+
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    Kmeans *k = createRoot(mesh, bounds, arena);
+    k->registerCallback(m_callback);
+    k->setTaskParallel(options.task_parallel);
+
+    if (options.task_parallel) {
+        // 由一个线程展开根节点, 其余线程在隐式barrier处窃取子树task
+        #pragma omp parallel
+        #pragma omp single
+        k->constructKaryTree(0);
+    } else {
+        k->constructKaryTree(0);
+    }
+
+    auto end_time = std::chrono::high_resolution_clock::now();
+    long long elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
+
+    std::cout << "[Log] K-means BVH Building Completed: " << elapsed_us << " us"
+              << (options.task_parallel ? " (task parallel, " + std::to_string(omp_get_max_threads()) + " threads)" : "")
+              << std::endl;
+    if (m_referenceUs > 0 && elapsed_us > 0) {
+        std::cout << "[Log] Speedup over serial recursion: " << (double)m_referenceUs / elapsed_us << "x" << std::endl;
+    }
+
+    size_t iterations = 0, nodes = 0;
+    k->iterationStats(iterations, nodes);
+    std::cout << "[Log] K-means iterations: " << iterations << " over " << nodes << " nodes ("
+              << (double)iterations / std::max<size_t>(nodes, 1) << " per node)" << std::endl;
+    const size_t median_splits = k->medianSplits();
+    if (median_splits > 0) {
+        std::cout << "[Log] Median split fallback: " << median_splits << " nodes" << std::endl;
+    }
+
+    if (options.prune) {
+        uint64_t evaluations = 0, avoided = 0;
+        k->pruningStats(evaluations, avoided);
+        std::cout << "[Log] Pruned assignment: " << evaluations << " distance evaluations, " << avoided << " avoided ("
+                  << 100.0 * avoided / std::max<uint64_t>(evaluations + avoided, 1) << "%)" << std::endl;
+    }
+
+    // SAH代价按根节点面积归一化
+    const double root_area = k->world.surface_area();
+    std::cout << "[Log] K-ary tree SAH cost: "
+              << k->sahCost(options.traversal_cost, options.intersection_cost) / root_area << std::endl;
+
+    if (options.refine) {
+        std::cout << "[Log] Agglomerative refinement..." << std::endl;
+        start_time = std::chrono::high_resolution_clock::now();
+        if (options.task_parallel) {
+            #pragma omp parallel
+            #pragma omp single
+            k->buttom2Top();
+        } else {
+            k->buttom2Top();
+        }
+        end_time = std::chrono::high_resolution_clock::now();
+        long long refine_us = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
+
+        std::cout << "[Log] Agglomerative refinement Completed: " << refine_us << " us (total "
+                  << elapsed_us + refine_us << " us)" << std::endl;
+        std::cout << "[Log] Binary tree SAH cost: " << k->root->sahCost(options.traversal_cost, options.intersection_cost) / root_area << std::endl;
+    }
+
+    const LinearBVH::Layout layout = options.bfs_layout ? LinearBVH::Layout::BFS : LinearBVH::Layout::DFS;
+    if (options.refine) {
+        bvh.flatten(k->root, layout);
+    } else {
+        bvh.flatten(k, layout);
+    }
+}
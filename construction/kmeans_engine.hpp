@@ -0,0 +1,36 @@
+#ifndef KMEANS_ENGINE_H_
+#define KMEANS_ENGINE_H_
+
+#include "bbox.hpp"
+#include "build_engine.hpp"
+#include "kmeans.hpp"
+
+#include <functional>
+
+// k-means聚类构造k叉树 (可选凝聚聚类细化为二叉树), 参数见 BuildOptions
+class KmeansEngine : public BuildEngine {
+public:
+    explicit KmeansEngine(std::function<void(const BoundingBox, const bool)> callback)
+        : m_callback(callback)
+    {
+    }
+
+    const char* name() const override { return "K-means"; }
+
+    // 选择kernel指令集, --bench_kernel时测量kernel, --compare时运行串行递归的参照构造
+    void prepare(const TriangleMesh& mesh, PrimitiveBounds& bounds) override;
+
+    void build(const TriangleMesh& mesh, PrimitiveBounds& bounds, Arena& arena, LinearBVH& bvh) override;
+
+private:
+    // 按BuildOptions配置的根节点; 参照构造与计时构造共用, 两者只差递归方式 (task) 与callback
+    Kmeans* createRoot(const TriangleMesh& mesh, PrimitiveBounds& bounds, Arena& arena) const;
+
+    std::function<void(const BoundingBox, const bool)> m_callback;
+    Kmeans::LeafPolicy m_leafPolicy;
+    Kmeans::Seeding m_seeding = Kmeans::Seeding::Heuristic;
+    // 参照构造的时间, 未运行时为0
+    long long m_referenceUs = 0;
+};
+
+#endif // KMEANS_ENGINE_H_
@@ -0,0 +1,294 @@
+#include "lbvh.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <omp.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// 未指定--max_leaf时叶子的图元数上限
+#define defaultMaxLeaf 4
+// 基数排序每块的元素数, 每块有自己的直方图
+#define radixBlockSize 16384
+
+namespace {
+    long long elapsed_us(std::chrono::high_resolution_clock::time_point start)
+    {
+        auto now = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration_cast<std::chrono::microseconds>(now - start).count();
+    }
+
+    // 把低10位分散到每3位的最低位
+    inline uint64_t expand_bits_10(uint64_t x)
+    {
+        x &= 0x3ff;
+        x = (x | (x << 16)) & 0x030000ff;
+        x = (x | (x << 8)) & 0x0300f00f;
+        x = (x | (x << 4)) & 0x030c30c3;
+        x = (x | (x << 2)) & 0x09249249;
+        return x;
+    }
+
+    // 把低21位分散到每3位的最低位
+    inline uint64_t expand_bits_21(uint64_t x)
+    {
+        x &= 0x1fffff;
+        x = (x | (x << 32)) & 0x001f00000000ffffull;
+        x = (x | (x << 16)) & 0x001f0000ff0000ffull;
+        x = (x | (x << 8)) & 0x100f00f00f00f00full;
+        x = (x | (x << 4)) & 0x10c30c30c30c30c3ull;
+        x = (x | (x << 2)) & 0x1249249249249249ull;
+        return x;
+    }
+
+    // 稳定的LSD基数排序 (8位一趟), 同时移动values
+    // 直方图按 (数字, 块) 的顺序求前缀和, 结果与分块方式无关
+    void radix_sort(std::vector<uint64_t>& keys, std::vector<uint32_t>& values, int bits)
+    {
+        const size_t n = keys.size();
+        const size_t blocks = std::max<size_t>((n + radixBlockSize - 1) / radixBlockSize, 1);
+        std::vector<uint64_t> key_buffer(n);
+        std::vector<uint32_t> value_buffer(n);
+        std::vector<size_t> histogram(blocks * 256);
+
+        for (int shift = 0; shift < bits; shift += 8) {
+            #pragma omp parallel for schedule(static)
+            for (long long b = 0; b < (long long)blocks; ++b) {
+                size_t* count = &histogram[b * 256];
+                std::fill(count, count + 256, 0);
+                const size_t first = static_cast<size_t>(b) * radixBlockSize;
+                const size_t end = std::min<size_t>(n, first + radixBlockSize);
+                for (size_t i = first; i < end; ++i)
+                    ++count[(keys[i] >> shift) & 0xff];
+            }
+
+            size_t offset = 0;
+            for (size_t digit = 0; digit < 256; ++digit) {
+                for (size_t b = 0; b < blocks; ++b) {
+                    const size_t count = histogram[b * 256 + digit];
+                    histogram[b * 256 + digit] = offset;
+                    offset += count;
+                }
+            }
+
+            #pragma omp parallel for schedule(static)
+            for (long long b = 0; b < (long long)blocks; ++b) {
+                size_t* next = &histogram[b * 256];
+                const size_t first = static_cast<size_t>(b) * radixBlockSize;
+                const size_t end = std::min<size_t>(n, first + radixBlockSize);
+                for (size_t i = first; i < end; ++i) {
+                    const size_t dst = next[(keys[i] >> shift) & 0xff]++;
+                    key_buffer[dst] = keys[i];
+                    value_buffer[dst] = values[i];
+                }
+            }
+            keys.swap(key_buffer);
+            values.swap(value_buffer);
+        }
+    }
+
+    // 前导零个数, x不为0
+    inline int clz64(uint64_t x)
+    {
+#if defined(_MSC_VER)
+        // _BitScanReverse64不要求LZCNT指令
+        unsigned long index;
+        _BitScanReverse64(&index, x);
+        return 63 - (int)index;
+#else
+        return __builtin_clzll(x);
+#endif
+    }
+
+    // Karras的δ(i, j): 码的最长公共前缀长度, 码相同时以下标区分; 越界为-1
+    inline int delta(const std::vector<uint64_t>& codes, long long i, long long j)
+    {
+        if (j < 0 || j >= (long long)codes.size())
+            return -1;
+        const uint64_t x = codes[i] ^ codes[j];
+        if (x != 0)
+            return clz64(x);
+        return 64 + clz64((uint64_t)(i ^ j));
+    }
+} // namespace
+
+LBVH::LBVH(int morton_bits, size_t max_leaf, LinearBVH::Layout layout)
+    : m_mortonBits(morton_bits == 63 ? 63 : 30)
+    , m_maxLeaf(max_leaf > 0 ? max_leaf : defaultMaxLeaf)
+    , m_layout(layout)
+{
+}
+
+std::vector<uint64_t> LBVH::sortByMorton(PrimitiveBounds& bounds, int morton_bits)
+{
+    const size_t n = bounds.size();
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    // 图元中心的包围盒, 每个线程先求局部的再合并
+    float lo[3] = { INF_F, INF_F, INF_F };
+    float hi[3] = { -INF_F, -INF_F, -INF_F };
+    #pragma omp parallel
+    {
+        float local_lo[3] = { INF_F, INF_F, INF_F };
+        float local_hi[3] = { -INF_F, -INF_F, -INF_F };
+        #pragma omp for schedule(static) nowait
+        for (long long i = 0; i < (long long)n; ++i) {
+            const float c[3] = { 0.5f * (bounds.minX[i] + bounds.maxX[i]), 0.5f * (bounds.minY[i] + bounds.maxY[i]),
+                                 0.5f * (bounds.minZ[i] + bounds.maxZ[i]) };
+            for (int a = 0; a < 3; ++a) {
+                local_lo[a] = std::min(local_lo[a], c[a]);
+                local_hi[a] = std::max(local_hi[a], c[a]);
+            }
+        }
+        #pragma omp critical
+        for (int a = 0; a < 3; ++a) {
+            lo[a] = std::min(lo[a], local_lo[a]);
+            hi[a] = std::max(hi[a], local_hi[a]);
+        }
+    }
+
+    // 每个轴量化到 [0, 2^bits)
+    const int axis_bits = morton_bits == 63 ? 21 : 10;
+    const float cells = static_cast<float>(1u << axis_bits);
+    float scale[3];
+    for (int a = 0; a < 3; ++a)
+        scale[a] = hi[a] > lo[a] ? cells / (hi[a] - lo[a]) : 0.0f;
+
+    std::vector<uint64_t> codes(n);
+    std::vector<uint32_t> order(n);
+    #pragma omp parallel for schedule(static)
+    for (long long i = 0; i < (long long)n; ++i) {
+        const float c[3] = { 0.5f * (bounds.minX[i] + bounds.maxX[i]), 0.5f * (bounds.minY[i] + bounds.maxY[i]),
+                             0.5f * (bounds.minZ[i] + bounds.maxZ[i]) };
+        uint64_t q[3];
+        for (int a = 0; a < 3; ++a)
+            q[a] = static_cast<uint64_t>(std::min(std::max((c[a] - lo[a]) * scale[a], 0.0f), cells - 1.0f));
+        codes[i] = axis_bits == 21
+            ? (expand_bits_21(q[0]) << 2) | (expand_bits_21(q[1]) << 1) | expand_bits_21(q[2])
+            : (expand_bits_10(q[0]) << 2) | (expand_bits_10(q[1]) << 1) | expand_bits_10(q[2]);
+        order[i] = static_cast<uint32_t>(i);
+    }
+    std::cout << "[Log] Morton codes (" << morton_bits << "-bit): " << elapsed_us(start_time) << " us" << std::endl;
+
+    start_time = std::chrono::high_resolution_clock::now();
+    radix_sort(codes, order, morton_bits);
+
+    // 按码的顺序重排所有槽位
+    PrimitiveBounds sorted;
+    sorted.resize(n);
+    #pragma omp parallel for schedule(static)
+    for (long long i = 0; i < (long long)n; ++i)
+        sorted.copy(i, bounds, order[i]);
+    bounds = std::move(sorted);
+    std::cout << "[Log] Radix sort (" << (morton_bits + 7) / 8 << " passes): " << elapsed_us(start_time) << " us" << std::endl;
+
+    return codes;
+}
+
+void LBVH::build(const TriangleMesh& mesh, PrimitiveBounds& bounds, Arena& arena, LinearBVH& bvh)
+{
+    (void)mesh;
+    bvh.nodes.clear();
+    const size_t n = bounds.size();
+    if (n == 0)
+        return;
+
+    std::cout << "[Log] LBVH Building... (" << m_mortonBits << "-bit Morton codes, max leaf " << m_maxLeaf << ", "
+              << omp_get_max_threads() << " threads)" << std::endl;
+    const std::vector<uint64_t> codes = sortByMorton(bounds, m_mortonBits);
+
+    // 节点: [0, n - 1) 为内部节点 (0为根), [n - 1, 2n - 1) 为叶子, 叶子i对应槽位i
+    auto start_time = std::chrono::high_resolution_clock::now();
+    const size_t internal = n - 1;
+    KBVHNode* nodes = arena.allocate<KBVHNode>(2 * n - 1);
+    std::vector<uint32_t> parent(2 * n - 1, 0);
+
+    #pragma omp parallel for schedule(static)
+    for (long long i = 0; i < (long long)n; ++i) {
+        KBVHNode* leaf = new (nodes + internal + i) KBVHNode(bounds.get_bbox(i), 1);
+        leaf->begin = i;
+        leaf->end = i + 1;
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (long long i = 0; i < (long long)internal; ++i) {
+        // 方向: 与公共前缀更长的一侧相邻
+        const int d = delta(codes, i, i + 1) - delta(codes, i, i - 1) >= 0 ? 1 : -1;
+        const int delta_min = delta(codes, i, i - d);
+
+        // 指数增长求区间长度的上界, 再二分求另一端j
+        long long length_max = 2;
+        while (delta(codes, i, i + length_max * d) > delta_min)
+            length_max *= 2;
+        long long length = 0;
+        for (long long t = length_max / 2; t >= 1; t /= 2) {
+            if (delta(codes, i, i + (length + t) * d) > delta_min)
+                length += t;
+        }
+        const long long j = i + length * d;
+
+        // 二分求公共前缀变短的位置, 即左右子树的分界
+        const int delta_node = delta(codes, i, j);
+        long long s = 0;
+        long long t = length;
+        do {
+            t = (t + 1) / 2;
+            if (delta(codes, i, i + (s + t) * d) > delta_node)
+                s += t;
+        } while (t > 1);
+        const long long gamma = i + s * d + std::min(d, 0);
+
+        const long long first = std::min(i, j), last = std::max(i, j);
+        const size_t left = first == gamma ? internal + gamma : gamma;
+        const size_t right = last == gamma + 1 ? internal + gamma + 1 : gamma + 1;
+
+        KBVHNode* node = new (nodes + i) KBVHNode(BoundingBox(), static_cast<uint32_t>(last - first + 1));
+        node->begin = first;
+        node->end = last + 1;
+        node->l = nodes + left;
+        node->r = nodes + right;
+        parent[left] = static_cast<uint32_t>(i);
+        parent[right] = static_cast<uint32_t>(i);
+    }
+    std::cout << "[Log] LBVH hierarchy (" << internal << " internal nodes): " << elapsed_us(start_time) << " us" << std::endl;
+
+    // 自底向上拟合: 每个内部节点被访问两次, 第二次 (两个子节点都已完成) 时合并
+    start_time = std::chrono::high_resolution_clock::now();
+    std::unique_ptr<std::atomic<uint32_t>[]> visits(new std::atomic<uint32_t>[internal + 1]);
+    #pragma omp parallel for schedule(static)
+    for (long long i = 0; i < (long long)internal; ++i)
+        visits[i].store(0, std::memory_order_relaxed);
+
+    #pragma omp parallel for schedule(static)
+    for (long long i = 0; i < (long long)n; ++i) {
+        if (internal == 0)
+            continue;
+        size_t current = parent[internal + i];
+        while (true) {
+            if (visits[current].fetch_add(1, std::memory_order_acq_rel) == 0)
+                break;
+            KBVHNode& node = nodes[current];
+            BoundingBox bb = node.l->bb;
+            bb.expand(node.r->bb);
+            node.bb = bb;
+            if (current == 0)
+                break;
+            current = parent[current];
+        }
+    }
+
+    // 图元数不超过max_leaf的子树折叠为叶子 (其下的节点不再可达)
+    #pragma omp parallel for schedule(static)
+    for (long long i = 0; i < (long long)internal; ++i) {
+        if (nodes[i].count <= m_maxLeaf)
+            nodes[i].l = nodes[i].r = NULL;
+    }
+    std::cout << "[Log] LBVH bottom-up fit: " << elapsed_us(start_time) << " us" << std::endl;
+
+    bvh.flatten(internal > 0 ? nodes : nodes + internal, m_layout);
+}
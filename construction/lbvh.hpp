@@ -0,0 +1,37 @@
+#ifndef LBVH_H_
+#define LBVH_H_
+
+#include "build_engine.hpp"
+#include "kmeans.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 线性BVH (LBVH): 以图元中心的Morton码排序, 再由相邻码的最长公共前缀直接得到二叉树
+// 每一步都是数据并行的:
+//   1. 计算30位 (每轴10位) 或63位 (每轴21位) Morton码
+//   2. 按8位一趟的LSD基数排序, 每块统计直方图, 按 (数字, 块) 的顺序求前缀和后并行分发
+//   3. Karras (2012) 的层次构造: n - 1 个内部节点各自独立地求出覆盖区间与划分位置
+//   4. 自底向上拟合包围盒: 每个叶子沿父节点上行, 第二个到达内部节点的线程负责合并
+// 图元数不超过max_leaf的子树最后折叠为一个叶子
+class LBVH : public BuildEngine {
+public:
+    // morton_bits: 30或63; max_leaf为0时使用默认的叶子图元数上限
+    LBVH(int morton_bits, size_t max_leaf, LinearBVH::Layout layout);
+
+    const char* name() const override { return "LBVH"; }
+
+    void build(const TriangleMesh& mesh, PrimitiveBounds& bounds, Arena& arena, LinearBVH& bvh) override;
+
+    // 在bounds的全部槽位上计算Morton码并排序, 按码的顺序重排bounds, 返回排序后的码
+    // PLOC的初始cluster同样按此排序
+    static std::vector<uint64_t> sortByMorton(PrimitiveBounds& bounds, int morton_bits);
+
+private:
+    int m_mortonBits;
+    size_t m_maxLeaf;
+    LinearBVH::Layout m_layout;
+};
+
+#endif // LBVH_H_
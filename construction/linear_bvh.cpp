@@ -0,0 +1,152 @@
+#include "linear_bvh.hpp"
+
+#include <deque>
+#include <limits>
+
+namespace {
+    // k叉树中的一项: cluster为npos时为Kmeans节点本身, 否则为没有子节点的cluster (叶子)
+    struct KaryItem {
+        static const size_t npos = std::numeric_limits<size_t>::max();
+        const Kmeans* node;
+        size_t cluster;
+    };
+
+    BoundingBox bbox_of(const KaryItem& item)
+    {
+        return item.cluster == KaryItem::npos ? item.node->world : item.node->cluster[item.cluster].world;
+    }
+
+    bool leaf_range(const KaryItem& item, size_t& begin, size_t& end)
+    {
+        if (item.cluster == KaryItem::npos)
+            return false;
+        begin = item.node->cluster[item.cluster].begin;
+        end = item.node->cluster[item.cluster].end;
+        return true;
+    }
+
+    void children_of(const KaryItem& item, std::vector<KaryItem>& out)
+    {
+        const Kmeans* node = item.node;
+        for (size_t i = 0; i < node->m_K; ++i) {
+            if (node->cluster[i].size() == 0)
+                continue;
+            const Kmeans* child = node->child(i);
+            out.push_back(child ? KaryItem{child, KaryItem::npos} : KaryItem{node, i});
+        }
+    }
+
+    BoundingBox bbox_of(const KBVHNode* node) { return node->bb; }
+
+    bool leaf_range(const KBVHNode* node, size_t& begin, size_t& end)
+    {
+        if (!node->isLeaf())
+            return false;
+        begin = node->begin;
+        end = node->end;
+        return true;
+    }
+
+    void children_of(const KBVHNode* node, std::vector<const KBVHNode*>& out)
+    {
+        out.push_back(node->l);
+        out.push_back(node->r);
+    }
+
+    LinearBVH::Node make_node(const BoundingBox& bb)
+    {
+        LinearBVH::Node node;
+        node.min[0] = bb.min.x; node.min[1] = bb.min.y; node.min[2] = bb.min.z;
+        node.max[0] = bb.max.x; node.max[1] = bb.max.y; node.max[2] = bb.max.z;
+        node.offset = 0;
+        node.primitiveCount = 0;
+        node.childCount = 0;
+        return node;
+    }
+
+    // 节点被取出时为其子节点分配一段连续的下标
+    // DFS从栈顶取 (子节点逆序入栈, 保持子节点的原始顺序), BFS从队首取
+    template <typename Item>
+    void flatten_tree(const Item& root, LinearBVH::Layout layout, std::vector<LinearBVH::Node>& nodes)
+    {
+        std::deque<std::pair<uint32_t, Item>> pending;
+        std::vector<Item> children;
+
+        nodes.push_back(make_node(bbox_of(root)));
+        pending.emplace_back(0, root);
+        while (!pending.empty()) {
+            std::pair<uint32_t, Item> current;
+            if (layout == LinearBVH::Layout::DFS) {
+                current = pending.back();
+                pending.pop_back();
+            } else {
+                current = pending.front();
+                pending.pop_front();
+            }
+
+            size_t begin, end;
+            if (leaf_range(current.second, begin, end)) {
+                nodes[current.first].offset = static_cast<uint32_t>(begin);
+                nodes[current.first].primitiveCount = static_cast<uint16_t>(end - begin);
+                continue;
+            }
+
+            children.clear();
+            children_of(current.second, children);
+            const uint32_t first = static_cast<uint32_t>(nodes.size());
+            nodes[current.first].offset = first;
+            nodes[current.first].childCount = static_cast<uint16_t>(children.size());
+            for (const Item& child : children)
+                nodes.push_back(make_node(bbox_of(child)));
+
+            if (layout == LinearBVH::Layout::DFS) {
+                for (size_t i = children.size(); i-- > 0;)
+                    pending.emplace_back(first + i, children[i]);
+            } else {
+                for (size_t i = 0; i < children.size(); ++i)
+                    pending.emplace_back(first + i, children[i]);
+            }
+        }
+    }
+} // namespace
+
+void LinearBVH::flatten(const Kmeans* root, Layout layout)
+{
+    nodes.clear();
+    if (root)
+        flatten_tree(KaryItem{root, KaryItem::npos}, layout, nodes);
+}
+
+void LinearBVH::flatten(const KBVHNode* root, Layout layout)
+{
+    nodes.clear();
+    if (root)
+        flatten_tree(root, layout, nodes);
+}
+
+void LinearBVH::reorder(const TriangleMesh& mesh, const PrimitiveBounds& bounds)
+{
+    const size_t n = bounds.size();
+    triangles.assign(bounds.index.begin(), bounds.index.end());
+    indices.resize(n * 3);
+    #pragma omp parallel for schedule(static)
+    for (long long slot = 0; slot < (long long)n; ++slot) {
+        const size_t source = triangles[slot];
+        indices[slot * 3] = mesh.indices[source * 3];
+        indices[slot * 3 + 1] = mesh.indices[source * 3 + 1];
+        indices[slot * 3 + 2] = mesh.indices[source * 3 + 2];
+    }
+}
+
+double LinearBVH::sahCost(float traversal, float intersection) const
+{
+    if (nodes.empty())
+        return 0.0;
+    double cost = 0.0;
+    for (const Node& node : nodes) {
+        const double area = node.bbox().surface_area();
+        cost += node.isLeaf() ? area * node.primitiveCount * intersection : area * traversal;
+    }
+    const double root_area = nodes[0].bbox().surface_area();
+    return root_area > 0.0 ? cost / root_area : 0.0;
+}
@@ -0,0 +1,61 @@
+#ifndef LINEAR_BVH_H_
+#define LINEAR_BVH_H_
+
+#include "bbox.hpp"
+#include "kmeans.hpp"
+#include "primitive_bounds.hpp"
+#include "triangle_mesh.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// 构造结果的线性化表示, 构造完成后即可释放Kmeans节点图
+// 同一个节点的子节点在数组中连续存放, k叉树与二叉树共用同一种节点
+class LinearBVH {
+public:
+    // 32字节, 两个节点占一条cache line
+    struct Node {
+        float min[3];
+        // 内部节点: 第一个子节点的下标; 叶子: 第一个三角形在triangles中的下标
+        uint32_t offset;
+        float max[3];
+        // 叶子的图元数, 内部节点为0
+        uint16_t primitiveCount;
+        // 内部节点的子节点数, 叶子为0
+        uint16_t childCount;
+
+        inline bool isLeaf() const { return childCount == 0; }
+        BoundingBox bbox() const { return BoundingBox(glm::vec3(min[0], min[1], min[2]), glm::vec3(max[0], max[1], max[2])); }
+    };
+
+    // 节点的排列顺序
+    // DFS: 子节点块按深度优先分配, 子树在数组中相对集中
+    // BFS: 按层分配, 同一层的节点相邻
+    enum class Layout {
+        DFS,
+        BFS,
+    };
+
+    // 根节点为nodes[0]
+    std::vector<Node> nodes;
+    // 按叶子区间重排后的三角形: 每个三角形3个位置下标 (指向TriangleMesh::positions)
+    std::vector<uint32_t> indices;
+    // 重排后每个位置的原三角形下标, 用于查找可选的属性流
+    std::vector<uint32_t> triangles;
+
+    // 从k叉树 (Kmeans) 或凝聚聚类细化后的二叉树 (KBVHNode) 生成节点数组
+    // 叶子区间为bounds中的槽位区间
+    void flatten(const Kmeans* root, Layout layout);
+    void flatten(const KBVHNode* root, Layout layout);
+
+    // 按bounds的槽位顺序重排三角形, 使叶子区间直接对应triangles中的区间
+    void reorder(const TriangleMesh& mesh, const PrimitiveBounds& bounds);
+
+    // 按根节点面积归一化的SAH代价: 内部节点面积 * traversal + 叶子面积 * 图元数 * intersection
+    // 与构造方式无关, 用于比较不同engine的结果
+    double sahCost(float traversal, float intersection) const;
+
+    size_t bytes() const { return nodes.size() * sizeof(Node) + (indices.size() + triangles.size()) * sizeof(uint32_t); }
+};
+
+#endif // LINEAR_BVH_H_
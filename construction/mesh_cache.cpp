@@ -0,0 +1,154 @@
+#include "mesh_cache.hpp"
+#include "obj_reader.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <omp.h>
+
+// 散列时每块的字节数
+#define hashBlockSize (1 << 20)
+
+namespace mesh_cache {
+
+namespace {
+    const char magic[8] = {'B', 'V', 'H', 'M', 'E', 'S', 'H', '\0'};
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+        uint64_t source_hash;
+        uint64_t source_size;
+        uint64_t meshes;
+        uint64_t positions;
+        uint64_t triangles;
+        uint64_t padding;
+    };
+    static_assert(sizeof(Header) == 64, "mesh cache header must stay 64 bytes");
+
+    inline uint64_t fmix64(uint64_t x)
+    {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdull;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ull;
+        x ^= x >> 33;
+        return x;
+    }
+
+    // 4路交错, 使乘法的依赖链互不等待
+    uint64_t hash_block(const char* data, size_t size, uint64_t seed)
+    {
+        uint64_t lane[4] = {seed, seed ^ 0x9E3779B97F4A7C15ull, seed ^ 0xC2B2AE3D27D4EB4Full, seed ^ 0x165667B19E3779F9ull};
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32) {
+            for (int l = 0; l < 4; ++l) {
+                uint64_t word;
+                memcpy(&word, data + i + l * 8, sizeof(word));
+                lane[l] = (lane[l] ^ fmix64(word)) * 0x9E3779B97F4A7C15ull;
+            }
+        }
+        uint64_t h = fmix64(lane[0]) ^ fmix64(lane[1] + 1) ^ fmix64(lane[2] + 2) ^ fmix64(lane[3] + 3);
+        for (; i < size; ++i)
+            h = (h ^ (unsigned char)data[i]) * 0x100000001B3ull;
+        return fmix64(h ^ size);
+    }
+} // namespace
+
+std::string path_for(const std::string& obj_path)
+{
+    return obj_path + ".meshcache";
+}
+
+uint64_t hash(const char* data, size_t size)
+{
+    const size_t blocks = (size + hashBlockSize - 1) / hashBlockSize;
+    std::vector<uint64_t> block_hash(blocks);
+    #pragma omp parallel for schedule(static)
+    for (long long b = 0; b < (long long)blocks; ++b) {
+        const size_t begin = b * (size_t)hashBlockSize;
+        block_hash[b] = hash_block(data + begin, std::min<size_t>(hashBlockSize, size - begin), b);
+    }
+    uint64_t h = fmix64(size);
+    for (uint64_t value : block_hash)
+        h = fmix64(h ^ value) * 0x9E3779B97F4A7C15ull;
+    return h;
+}
+
+bool load(const std::string& path, uint64_t source_hash, uint64_t source_size, TriangleMesh& mesh)
+{
+    obj::MappedFile file;
+    if (!file.open(path) || file.size() < sizeof(Header))
+        return false;
+    Header header;
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version || header.source_hash != source_hash
+        || header.source_size != source_size || header.meshes == 0)
+        return false;
+    const size_t expected = sizeof(Header) + header.meshes * sizeof(uint64_t) + header.positions * 3 * sizeof(float)
+                            + header.triangles * 3 * sizeof(uint32_t);
+    if (file.size() != expected)
+        return false;
+
+    // 各段都按元素大小对齐 (Header为64字节)
+    const uint64_t* meshes = reinterpret_cast<const uint64_t*>(file.data() + sizeof(Header));
+    const glm::vec3* positions = reinterpret_cast<const glm::vec3*>(meshes + header.meshes);
+    const uint32_t* triangles = reinterpret_cast<const uint32_t*>(positions + header.positions);
+    bool invalid = false;
+    #pragma omp parallel for schedule(static) reduction(|| : invalid)
+    for (long long i = 0; i < (long long)(header.triangles * 3); ++i)
+        invalid = invalid || triangles[i] >= header.positions;
+    if (invalid)
+        return false;
+    // 对象表: 从0开始, 不递减, 不超过三角形数, 否则assignObjects()会越界
+    if (meshes[0] != 0)
+        return false;
+    for (size_t m = 0; m < header.meshes; ++m) {
+        if (meshes[m] > header.triangles || (m > 0 && meshes[m] < meshes[m - 1]))
+            return false;
+    }
+
+    mesh.clear();
+    mesh.objectBegin.assign(meshes, meshes + header.meshes);
+    mesh.positions.assign(positions, positions + header.positions);
+    mesh.indices.assign(triangles, triangles + header.triangles * 3);
+    return true;
+}
+
+bool store(const std::string& path, uint64_t source_hash, uint64_t source_size, const TriangleMesh& mesh)
+{
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.source_hash = source_hash;
+    header.source_size = source_size;
+    header.meshes = mesh.objectBegin.size();
+    header.positions = mesh.positions.size();
+    header.triangles = mesh.size();
+    const std::vector<uint64_t> meshes(mesh.objectBegin.begin(), mesh.objectBegin.end());
+
+    // 先写临时文件, 避免另一个进程读到写了一半的缓存
+    const std::string temp = path + ".tmp";
+    FILE* file = fopen(temp.c_str(), "wb");
+    if (file == nullptr)
+        return false;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && fwrite(meshes.data(), sizeof(uint64_t), meshes.size(), file) == meshes.size();
+    ok = ok && fwrite(mesh.positions.data(), sizeof(glm::vec3), mesh.positions.size(), file) == mesh.positions.size();
+    ok = ok && fwrite(mesh.indices.data(), sizeof(uint32_t), mesh.indices.size(), file) == mesh.indices.size();
+    ok = fclose(file) == 0 && ok;
+    if (ok) {
+#ifdef _WIN32
+        // Windows上rename不覆盖已有文件
+        std::remove(path.c_str());
+#endif
+        ok = std::rename(temp.c_str(), path.c_str()) == 0;
+    }
+    if (!ok)
+        std::remove(temp.c_str());
+    return ok;
+}
+
+} // namespace mesh_cache
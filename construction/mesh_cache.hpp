@@ -0,0 +1,35 @@
+#ifndef MESH_CACHE_H_
+#define MESH_CACHE_H_
+
+#include "triangle_mesh.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// OBJ的二进制缓存, 与OBJ放在同一目录 (<obj路径>.meshcache)
+// 第一次读取OBJ后写入, 之后映射缓存直接复制位置与下标, 不再解析文本
+// 文件布局 (本机字节序):
+//   Header
+//   uint64_t object_begin[objects]     每个对象第一个三角形的下标
+//   float    positions[positions][3]   去重前的OBJ顶点位置
+//   uint32_t triangles[triangles][3]   每个三角形的位置下标
+// 只保存位置与下标, 不含可选的属性流
+namespace mesh_cache {
+    // 文件格式改变时递增
+    const uint32_t version = 1;
+
+    std::string path_for(const std::string& obj_path);
+
+    // OBJ内容的64位散列, 按块并行计算, 结果与线程数无关
+    uint64_t hash(const char* data, size_t size);
+
+    // 读取缓存, 文件不存在, 版本不同, 散列/大小与OBJ不符或内容损坏 (下标或对象表越界) 时返回false
+    bool load(const std::string& path, uint64_t source_hash, uint64_t source_size, TriangleMesh& mesh);
+
+    // 写入临时文件后重命名, 失败时返回false (例如目录不可写)
+    bool store(const std::string& path, uint64_t source_hash, uint64_t source_size, const TriangleMesh& mesh);
+} // namespace mesh_cache
+
+#endif // MESH_CACHE_H_
@@ -0,0 +1,417 @@
+#include "nearest_kernel.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define KERNEL_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC/Clang 需要为使用高级指令集的函数单独指定target, 程序本身仍按基础指令集编译,
+// 运行时根据CPU选择kernel. MSVC 无需指定即可使用intrinsics
+#if defined(__GNUC__) || defined(__clang__)
+#define KERNEL_TARGET(isa) __attribute__((target(isa)))
+#else
+#define KERNEL_TARGET(isa)
+#endif
+
+namespace kernel {
+    namespace {
+        template <size_t K>
+        void nearest_scalar(PrimitiveBounds& bounds, size_t begin, size_t end, const float* c, size_t kr)
+        {
+            const size_t k = K > 0 ? K : kr;
+            const float *cminx = c, *cminy = c + k, *cminz = c + 2 * k;
+            const float *cmaxx = c + 3 * k, *cmaxy = c + 4 * k, *cmaxz = c + 5 * k;
+            for (size_t i = begin; i < end; ++i) {
+                float best = std::numeric_limits<float>::infinity();
+                uint8_t best_idx = 0;
+                for (size_t j = 0; j < k; ++j) {
+                    float dx = bounds.minX[i] - cminx[j];
+                    float dy = bounds.minY[i] - cminy[j];
+                    float dz = bounds.minZ[i] - cminz[j];
+                    float ex = bounds.maxX[i] - cmaxx[j];
+                    float ey = bounds.maxY[i] - cmaxy[j];
+                    float ez = bounds.maxZ[i] - cmaxz[j];
+                    float d = std::sqrt(dx * dx + dy * dy + dz * dz) + std::sqrt(ex * ex + ey * ey + ez * ez);
+                    if (d < best) {
+                        best = d;
+                        best_idx = static_cast<uint8_t>(j);
+                    }
+                }
+                bounds.label[i] = best_idx;
+            }
+        }
+
+        void bounded_scalar(const PrimitiveBounds& bounds, const uint32_t* slots, size_t count,
+                            const float* c, size_t k, uint8_t* label, float* best_out, float* second_out)
+        {
+            const float *cminx = c, *cminy = c + k, *cminz = c + 2 * k;
+            const float *cmaxx = c + 3 * k, *cmaxy = c + 4 * k, *cmaxz = c + 5 * k;
+            for (size_t t = 0; t < count; ++t) {
+                const size_t i = slots[t];
+                float best = std::numeric_limits<float>::infinity();
+                float second = std::numeric_limits<float>::infinity();
+                uint8_t best_idx = 0;
+                for (size_t j = 0; j < k; ++j) {
+                    float dx = bounds.minX[i] - cminx[j];
+                    float dy = bounds.minY[i] - cminy[j];
+                    float dz = bounds.minZ[i] - cminz[j];
+                    float ex = bounds.maxX[i] - cmaxx[j];
+                    float ey = bounds.maxY[i] - cmaxy[j];
+                    float ez = bounds.maxZ[i] - cmaxz[j];
+                    float d = std::sqrt(dx * dx + dy * dy + dz * dz) + std::sqrt(ex * ex + ey * ey + ez * ez);
+                    if (d < best) {
+                        second = best;
+                        best = d;
+                        best_idx = static_cast<uint8_t>(j);
+                    } else if (d < second) {
+                        second = d;
+                    }
+                }
+                label[t] = best_idx;
+                best_out[t] = best;
+                second_out[t] = second;
+            }
+        }
+
+#ifdef KERNEL_X86
+        // 每次处理8个图元, 对每个centroid广播后比较
+        template <size_t K>
+        KERNEL_TARGET("avx2,fma")
+        void nearest_avx2(PrimitiveBounds& bounds, size_t begin, size_t end, const float* c, size_t kr)
+        {
+            const size_t k = K > 0 ? K : kr;
+            const float *cminx = c, *cminy = c + k, *cminz = c + 2 * k;
+            const float *cmaxx = c + 3 * k, *cmaxy = c + 4 * k, *cmaxz = c + 5 * k;
+            size_t i = begin;
+            for (; i + 8 <= end; i += 8) {
+                const __m256 pminx = _mm256_loadu_ps(&bounds.minX[i]);
+                const __m256 pminy = _mm256_loadu_ps(&bounds.minY[i]);
+                const __m256 pminz = _mm256_loadu_ps(&bounds.minZ[i]);
+                const __m256 pmaxx = _mm256_loadu_ps(&bounds.maxX[i]);
+                const __m256 pmaxy = _mm256_loadu_ps(&bounds.maxY[i]);
+                const __m256 pmaxz = _mm256_loadu_ps(&bounds.maxZ[i]);
+                __m256 best = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+                __m256 best_idx = _mm256_setzero_ps();
+                for (size_t j = 0; j < k; ++j) {
+                    __m256 dx = _mm256_sub_ps(pminx, _mm256_set1_ps(cminx[j]));
+                    __m256 dy = _mm256_sub_ps(pminy, _mm256_set1_ps(cminy[j]));
+                    __m256 dz = _mm256_sub_ps(pminz, _mm256_set1_ps(cminz[j]));
+                    __m256 ex = _mm256_sub_ps(pmaxx, _mm256_set1_ps(cmaxx[j]));
+                    __m256 ey = _mm256_sub_ps(pmaxy, _mm256_set1_ps(cmaxy[j]));
+                    __m256 ez = _mm256_sub_ps(pmaxz, _mm256_set1_ps(cmaxz[j]));
+                    __m256 dmin = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dz, dz)));
+                    __m256 dmax = _mm256_fmadd_ps(ex, ex, _mm256_fmadd_ps(ey, ey, _mm256_mul_ps(ez, ez)));
+                    __m256 d = _mm256_add_ps(_mm256_sqrt_ps(dmin), _mm256_sqrt_ps(dmax));
+                    // 严格小于: 距离相同时保留下标较小的centroid
+                    __m256 lt = _mm256_cmp_ps(d, best, _CMP_LT_OQ);
+                    best = _mm256_blendv_ps(best, d, lt);
+                    best_idx = _mm256_blendv_ps(best_idx, _mm256_castsi256_ps(_mm256_set1_epi32((int)j)), lt);
+                }
+                alignas(32) int32_t idx[8];
+                _mm256_store_si256(reinterpret_cast<__m256i*>(idx), _mm256_castps_si256(best_idx));
+                for (int t = 0; t < 8; ++t)
+                    bounds.label[i + t] = static_cast<uint8_t>(idx[t]);
+            }
+            nearest_scalar<K>(bounds, i, end, c, kr);
+        }
+
+        // 每次处理16个图元, 尾部用掩码处理
+        template <size_t K>
+        KERNEL_TARGET("avx512f")
+        void nearest_avx512(PrimitiveBounds& bounds, size_t begin, size_t end, const float* c, size_t kr)
+        {
+            const size_t k = K > 0 ? K : kr;
+            const float *cminx = c, *cminy = c + k, *cminz = c + 2 * k;
+            const float *cmaxx = c + 3 * k, *cmaxy = c + 4 * k, *cmaxz = c + 5 * k;
+            for (size_t i = begin; i < end; i += 16) {
+                const __mmask16 m = end - i >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (end - i)) - 1);
+                const __m512 pminx = _mm512_maskz_loadu_ps(m, &bounds.minX[i]);
+                const __m512 pminy = _mm512_maskz_loadu_ps(m, &bounds.minY[i]);
+                const __m512 pminz = _mm512_maskz_loadu_ps(m, &bounds.minZ[i]);
+                const __m512 pmaxx = _mm512_maskz_loadu_ps(m, &bounds.maxX[i]);
+                const __m512 pmaxy = _mm512_maskz_loadu_ps(m, &bounds.maxY[i]);
+                const __m512 pmaxz = _mm512_maskz_loadu_ps(m, &bounds.maxZ[i]);
+                __m512 best = _mm512_set1_ps(std::numeric_limits<float>::infinity());
+                __m512i best_idx = _mm512_setzero_si512();
+                for (size_t j = 0; j < k; ++j) {
+                    __m512 dx = _mm512_sub_ps(pminx, _mm512_set1_ps(cminx[j]));
+                    __m512 dy = _mm512_sub_ps(pminy, _mm512_set1_ps(cminy[j]));
+                    __m512 dz = _mm512_sub_ps(pminz, _mm512_set1_ps(cminz[j]));
+                    __m512 ex = _mm512_sub_ps(pmaxx, _mm512_set1_ps(cmaxx[j]));
+                    __m512 ey = _mm512_sub_ps(pmaxy, _mm512_set1_ps(cmaxy[j]));
+                    __m512 ez = _mm512_sub_ps(pmaxz, _mm512_set1_ps(cmaxz[j]));
+                    __m512 dmin = _mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(dy, dy, _mm512_mul_ps(dz, dz)));
+                    __m512 dmax = _mm512_fmadd_ps(ex, ex, _mm512_fmadd_ps(ey, ey, _mm512_mul_ps(ez, ez)));
+                    __m512 d = _mm512_add_ps(_mm512_sqrt_ps(dmin), _mm512_sqrt_ps(dmax));
+                    __mmask16 lt = _mm512_cmp_ps_mask(d, best, _CMP_LT_OQ);
+                    best = _mm512_mask_mov_ps(best, lt, d);
+                    best_idx = _mm512_mask_mov_epi32(best_idx, lt, _mm512_set1_epi32((int)j));
+                }
+                _mm512_mask_cvtepi32_storeu_epi8(&bounds.label[i], m, best_idx);
+            }
+        }
+
+        // 槽位不连续, 按slots gather后每次处理8个图元
+        // 次近距离: 比最近距离小时取原来的最近距离, 否则取两者较小的
+        // min_ps在有NaN时返回第二个操作数, d放在前面, 与标量版本一样忽略NaN距离 (空cluster的centroid)
+        KERNEL_TARGET("avx2,fma")
+        void bounded_avx2(const PrimitiveBounds& bounds, const uint32_t* slots, size_t count,
+                          const float* c, size_t k, uint8_t* label, float* best_out, float* second_out)
+        {
+            const float *cminx = c, *cminy = c + k, *cminz = c + 2 * k;
+            const float *cmaxx = c + 3 * k, *cmaxy = c + 4 * k, *cmaxz = c + 5 * k;
+            size_t t = 0;
+            for (; t + 8 <= count; t += 8) {
+                const __m256i idx = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(slots + t));
+                const __m256 pminx = _mm256_i32gather_ps(bounds.minX.data(), idx, 4);
+                const __m256 pminy = _mm256_i32gather_ps(bounds.minY.data(), idx, 4);
+                const __m256 pminz = _mm256_i32gather_ps(bounds.minZ.data(), idx, 4);
+                const __m256 pmaxx = _mm256_i32gather_ps(bounds.maxX.data(), idx, 4);
+                const __m256 pmaxy = _mm256_i32gather_ps(bounds.maxY.data(), idx, 4);
+                const __m256 pmaxz = _mm256_i32gather_ps(bounds.maxZ.data(), idx, 4);
+                __m256 best = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+                __m256 second = best;
+                __m256 best_idx = _mm256_setzero_ps();
+                for (size_t j = 0; j < k; ++j) {
+                    __m256 dx = _mm256_sub_ps(pminx, _mm256_set1_ps(cminx[j]));
+                    __m256 dy = _mm256_sub_ps(pminy, _mm256_set1_ps(cminy[j]));
+                    __m256 dz = _mm256_sub_ps(pminz, _mm256_set1_ps(cminz[j]));
+                    __m256 ex = _mm256_sub_ps(pmaxx, _mm256_set1_ps(cmaxx[j]));
+                    __m256 ey = _mm256_sub_ps(pmaxy, _mm256_set1_ps(cmaxy[j]));
+                    __m256 ez = _mm256_sub_ps(pmaxz, _mm256_set1_ps(cmaxz[j]));
+                    __m256 dmin = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dz, dz)));
+                    __m256 dmax = _mm256_fmadd_ps(ex, ex, _mm256_fmadd_ps(ey, ey, _mm256_mul_ps(ez, ez)));
+                    __m256 d = _mm256_add_ps(_mm256_sqrt_ps(dmin), _mm256_sqrt_ps(dmax));
+                    __m256 lt = _mm256_cmp_ps(d, best, _CMP_LT_OQ);
+                    second = _mm256_blendv_ps(_mm256_min_ps(d, second), best, lt);
+                    best = _mm256_blendv_ps(best, d, lt);
+                    best_idx = _mm256_blendv_ps(best_idx, _mm256_castsi256_ps(_mm256_set1_epi32((int)j)), lt);
+                }
+                alignas(32) int32_t idx_out[8];
+                _mm256_store_si256(reinterpret_cast<__m256i*>(idx_out), _mm256_castps_si256(best_idx));
+                for (int u = 0; u < 8; ++u)
+                    label[t + u] = static_cast<uint8_t>(idx_out[u]);
+                _mm256_storeu_ps(best_out + t, best);
+                _mm256_storeu_ps(second_out + t, second);
+            }
+            bounded_scalar(bounds, slots + t, count - t, c, k, label + t, best_out + t, second_out + t);
+        }
+
+        KERNEL_TARGET("avx512f")
+        void bounded_avx512(const PrimitiveBounds& bounds, const uint32_t* slots, size_t count,
+                            const float* c, size_t k, uint8_t* label, float* best_out, float* second_out)
+        {
+            const float *cminx = c, *cminy = c + k, *cminz = c + 2 * k;
+            const float *cmaxx = c + 3 * k, *cmaxy = c + 4 * k, *cmaxz = c + 5 * k;
+            for (size_t t = 0; t < count; t += 16) {
+                const __mmask16 m = count - t >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (count - t)) - 1);
+                const __m512i idx = _mm512_maskz_loadu_epi32(m, slots + t);
+                const __m512 zero = _mm512_setzero_ps();
+                const __m512 pminx = _mm512_mask_i32gather_ps(zero, m, idx, bounds.minX.data(), 4);
+                const __m512 pminy = _mm512_mask_i32gather_ps(zero, m, idx, bounds.minY.data(), 4);
+                const __m512 pminz = _mm512_mask_i32gather_ps(zero, m, idx, bounds.minZ.data(), 4);
+                const __m512 pmaxx = _mm512_mask_i32gather_ps(zero, m, idx, bounds.maxX.data(), 4);
+                const __m512 pmaxy = _mm512_mask_i32gather_ps(zero, m, idx, bounds.maxY.data(), 4);
+                const __m512 pmaxz = _mm512_mask_i32gather_ps(zero, m, idx, bounds.maxZ.data(), 4);
+                __m512 best = _mm512_set1_ps(std::numeric_limits<float>::infinity());
+                __m512 second = best;
+                __m512i best_idx = _mm512_setzero_si512();
+                for (size_t j = 0; j < k; ++j) {
+                    __m512 dx = _mm512_sub_ps(pminx, _mm512_set1_ps(cminx[j]));
+                    __m512 dy = _mm512_sub_ps(pminy, _mm512_set1_ps(cminy[j]));
+                    __m512 dz = _mm512_sub_ps(pminz, _mm512_set1_ps(cminz[j]));
+                    __m512 ex = _mm512_sub_ps(pmaxx, _mm512_set1_ps(cmaxx[j]));
+                    __m512 ey = _mm512_sub_ps(pmaxy, _mm512_set1_ps(cmaxy[j]));
+                    __m512 ez = _mm512_sub_ps(pmaxz, _mm512_set1_ps(cmaxz[j]));
+                    __m512 dmin = _mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(dy, dy, _mm512_mul_ps(dz, dz)));
+                    __m512 dmax = _mm512_fmadd_ps(ex, ex, _mm512_fmadd_ps(ey, ey, _mm512_mul_ps(ez, ez)));
+                    __m512 d = _mm512_add_ps(_mm512_sqrt_ps(dmin), _mm512_sqrt_ps(dmax));
+                    __mmask16 lt = _mm512_cmp_ps_mask(d, best, _CMP_LT_OQ);
+                    second = _mm512_mask_mov_ps(_mm512_min_ps(d, second), lt, best);
+                    best = _mm512_mask_mov_ps(best, lt, d);
+                    best_idx = _mm512_mask_mov_epi32(best_idx, lt, _mm512_set1_epi32((int)j));
+                }
+                _mm512_mask_cvtepi32_storeu_epi8(label + t, m, best_idx);
+                _mm512_mask_storeu_ps(best_out + t, m, best);
+                _mm512_mask_storeu_ps(second_out + t, m, second);
+            }
+        }
+#endif
+
+        bool cpu_supports(Isa isa)
+        {
+#ifdef KERNEL_X86
+#if defined(__GNUC__) || defined(__clang__)
+            // 可能在静态初始化阶段被调用, 早于libgcc的初始化
+            __builtin_cpu_init();
+            switch (isa) {
+            case Isa::AVX512:
+                return __builtin_cpu_supports("avx512f");
+            case Isa::AVX2:
+                return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+            default:
+                return true;
+            }
+#elif defined(_MSC_VER)
+            if (isa == Isa::Scalar)
+                return true;
+            int info[4];
+            __cpuid(info, 1);
+            const bool osxsave = (info[2] & (1 << 27)) != 0;
+            const bool fma = (info[2] & (1 << 12)) != 0;
+            if (!osxsave)
+                return false;
+            const unsigned long long xcr0 = _xgetbv(0);
+            __cpuidex(info, 7, 0);
+            if (isa == Isa::AVX2)
+                return fma && (info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+            return (info[1] & (1 << 16)) != 0 && (xcr0 & 0xE6) == 0xE6;
+#else
+            return isa == Isa::Scalar;
+#endif
+#else
+            return isa == Isa::Scalar;
+#endif
+        }
+
+        Isa g_active_isa = detect_isa();
+    } // namespace
+
+    const char* isa_name(Isa isa)
+    {
+        switch (isa) {
+        case Isa::AVX512:
+            return "avx512";
+        case Isa::AVX2:
+            return "avx2";
+        default:
+            return "scalar";
+        }
+    }
+
+    bool parse_isa(const char* name, Isa& isa)
+    {
+        for (Isa candidate : { Isa::Scalar, Isa::AVX2, Isa::AVX512 }) {
+            if (strcmp(name, isa_name(candidate)) == 0) {
+                isa = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    Isa detect_isa()
+    {
+        if (cpu_supports(Isa::AVX512))
+            return Isa::AVX512;
+        if (cpu_supports(Isa::AVX2))
+            return Isa::AVX2;
+        return Isa::Scalar;
+    }
+
+    Isa active_isa()
+    {
+        return g_active_isa;
+    }
+
+    void set_active_isa(Isa isa)
+    {
+        Isa supported = detect_isa();
+        g_active_isa = static_cast<int>(isa) > static_cast<int>(supported) ? supported : isa;
+    }
+
+    template <size_t K>
+    NearestKernel nearest_kernel(Isa isa)
+    {
+#ifdef KERNEL_X86
+        switch (isa) {
+        case Isa::AVX512:
+            return &nearest_avx512<K>;
+        case Isa::AVX2:
+            return &nearest_avx2<K>;
+        default:
+            break;
+        }
+#endif
+        return &nearest_scalar<K>;
+    }
+
+    BoundedKernel bounded_kernel(Isa isa)
+    {
+#ifdef KERNEL_X86
+        switch (isa) {
+        case Isa::AVX512:
+            return &bounded_avx512;
+        case Isa::AVX2:
+            return &bounded_avx2;
+        default:
+            break;
+        }
+#endif
+        return &bounded_scalar;
+    }
+
+    template NearestKernel nearest_kernel<0>(Isa isa);
+    template NearestKernel nearest_kernel<2>(Isa isa);
+    template NearestKernel nearest_kernel<4>(Isa isa);
+    template NearestKernel nearest_kernel<8>(Isa isa);
+    template NearestKernel nearest_kernel<16>(Isa isa);
+
+    void benchmark(PrimitiveBounds& bounds, size_t k)
+    {
+        const size_t n = bounds.size();
+        if (n == 0 || k == 0)
+            return;
+
+        // 取均匀分布在图元数组上的k个图元作为centroid
+        std::vector<float> centroids(6 * k);
+        for (size_t j = 0; j < k; ++j) {
+            size_t i = j * n / k;
+            centroids[j] = bounds.minX[i];
+            centroids[k + j] = bounds.minY[i];
+            centroids[2 * k + j] = bounds.minZ[i];
+            centroids[3 * k + j] = bounds.maxX[i];
+            centroids[4 * k + j] = bounds.maxY[i];
+            centroids[5 * k + j] = bounds.maxZ[i];
+        }
+
+        std::cout << "[Log] Nearest-centroid kernel benchmark (" << n << " primitives, K = " << k << ", single thread)" << std::endl;
+        const Isa supported = detect_isa();
+        for (Isa isa : { Isa::Scalar, Isa::AVX2, Isa::AVX512 }) {
+            if (static_cast<int>(isa) > static_cast<int>(supported)) {
+                std::cout << "[Log]   " << isa_name(isa) << ": not supported by this CPU" << std::endl;
+                continue;
+            }
+            NearestKernel nearest;
+            switch (k) {
+            case 2: nearest = nearest_kernel<2>(isa); break;
+            case 4: nearest = nearest_kernel<4>(isa); break;
+            case 8: nearest = nearest_kernel<8>(isa); break;
+            case 16: nearest = nearest_kernel<16>(isa); break;
+            default: nearest = nearest_kernel<0>(isa); break;
+            }
+
+            // 至少运行200ms
+            size_t passes = 0;
+            auto start_time = std::chrono::high_resolution_clock::now();
+            double elapsed_s = 0.0;
+            do {
+                nearest(bounds, 0, n, centroids.data(), k);
+                ++passes;
+                elapsed_s = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count();
+            } while (elapsed_s < 0.2);
+            std::cout << "[Log]   " << isa_name(isa) << ": " << (double)(n * passes) / elapsed_s / 1e6 << " M primitives/s" << std::endl;
+        }
+    }
+} // namespace kernel
@@ -0,0 +1,51 @@
+#ifndef NEAREST_KERNEL_H_
+#define NEAREST_KERNEL_H_
+
+#include "primitive_bounds.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+// k-means分配步骤的最近centroid kernel
+// 距离: |p.min - c.min| + |p.max - c.max|, 单精度
+// 对[begin, end)内的每个槽位计算最近的centroid, 写入bounds.label[i]
+// centroids布局 (SoA): [minX * k][minY * k][minZ * k][maxX * k][maxY * k][maxZ * k]
+namespace kernel {
+    // 指令集等级, 数值越大越新
+    enum class Isa {
+        Scalar = 0,
+        AVX2 = 1,
+        AVX512 = 2,
+    };
+
+    typedef void (*NearestKernel)(PrimitiveBounds& bounds, size_t begin, size_t end, const float* centroids, size_t k);
+
+    const char* isa_name(Isa isa);
+
+    // 解析 "scalar" / "avx2" / "avx512", 失败返回false
+    bool parse_isa(const char* name, Isa& isa);
+
+    // CPU (及操作系统) 支持的最高指令集
+    Isa detect_isa();
+
+    // 当前使用的指令集, 默认为detect_isa()
+    Isa active_isa();
+    // 限制使用的指令集, 超过CPU支持时取CPU支持的最高等级
+    void set_active_isa(Isa isa);
+
+    // K == 0 时使用运行期的k, 否则k必须等于K
+    template <size_t K>
+    NearestKernel nearest_kernel(Isa isa);
+
+    // Hamerly剪枝用: 对slots中的每个槽位求最近和次近的centroid及其距离,
+    // 结果按slots中的顺序写入label/best/second; k为运行期的值
+    typedef void (*BoundedKernel)(const PrimitiveBounds& bounds, const uint32_t* slots, size_t count,
+                                  const float* centroids, size_t k, uint8_t* label, float* best, float* second);
+
+    BoundedKernel bounded_kernel(Isa isa);
+
+    // 在所有图元上对每个可用的指令集测量kernel吞吐量 (primitives/s)
+    void benchmark(PrimitiveBounds& bounds, size_t k);
+} // namespace kernel
+
+#endif // NEAREST_KERNEL_H_
@@ -0,0 +1,458 @@
+#include "obj_reader.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <omp.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// 每个chunk至少的字节数, 小文件不拆分
+#define minChunkSize (1 << 20)
+
+namespace obj {
+
+bool MappedFile::open(const std::string& path)
+{
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return false;
+    }
+    m_file = file;
+    m_size = static_cast<size_t>(size.QuadPart);
+    if (m_size == 0)
+        return true;
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+        close();
+        return false;
+    }
+    m_mapping = mapping;
+    m_data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (m_data == nullptr) {
+        close();
+        return false;
+    }
+    return true;
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    m_size = static_cast<size_t>(st.st_size);
+    if (m_size == 0) {
+        ::close(fd);
+        return true;
+    }
+    void* p = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // 映射建立后即可关闭文件描述符
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        m_size = 0;
+        return false;
+    }
+    madvise(p, m_size, MADV_SEQUENTIAL);
+    m_data = static_cast<const char*>(p);
+    return true;
+#endif
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+    if (m_file)
+        CloseHandle(m_file);
+    m_mapping = nullptr;
+    m_file = nullptr;
+#else
+    if (m_data)
+        munmap(const_cast<char*>(m_data), m_size);
+#endif
+    m_data = nullptr;
+    m_size = 0;
+}
+
+namespace {
+    inline bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    inline const char* skip_blank(const char* p, const char* end)
+    {
+        while (p < end && is_blank(*p))
+            ++p;
+        return p;
+    }
+
+    // 解析一个float, 失败返回nullptr (from_chars不接受前导'+')
+    inline const char* parse_float(const char* p, const char* end, float& value)
+    {
+        p = skip_blank(p, end);
+        if (p < end && *p == '+')
+            ++p;
+        const std::from_chars_result result = std::from_chars(p, end, value);
+        return result.ec == std::errc() ? result.ptr : nullptr;
+    }
+
+    // OBJ的索引从1开始, 负数为相对于当前已有元素数的索引; 越界返回false
+    inline bool resolve(int32_t index, size_t count, uint32_t& out)
+    {
+        const long long resolved = index > 0 ? index - 1LL : (long long)count + index;
+        if (index == 0 || resolved < 0 || resolved >= (long long)count)
+            return false;
+        out = static_cast<uint32_t>(resolved);
+        return true;
+    }
+
+    // 面的一个顶点在文件中的原始下标, 纹理坐标/法线为0表示没有
+    // 解析后原地改写为全局下标
+    struct Corner {
+        int32_t position;
+        int32_t texcoord;
+        int32_t normal;
+    };
+
+    // 一个面: 顶点在chunk的corners中的区间, 以及面出现时chunk内已有的v / vt / vn个数
+    // 负数下标相对于 (之前所有chunk的个数 + 这里的个数) 解析, 与顺序读取的结果相同
+    struct Face {
+        uint32_t first;
+        uint32_t count;
+        uint32_t positions;
+        uint32_t texcoords;
+        uint32_t normals;
+    };
+
+    // o/g/usemtl出现的位置 (在chunk内第face个面之前), 顺序确定mesh的划分
+    struct MeshEvent {
+        size_t face;
+        size_t triangle;
+        bool group;
+    };
+
+    // 文件中以换行对齐的一段, 并行解析
+    struct Chunk {
+        const char* begin;
+        const char* end;
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec2> texcoords;
+        std::vector<glm::vec3> normals;
+        std::vector<Face> faces;
+        std::vector<Corner> corners;
+        std::vector<MeshEvent> events;
+        size_t skipped = 0;
+        size_t valid_faces = 0;
+        size_t triangles = 0;
+        // 之前所有chunk的v / vt / vn / 三角形个数 (前缀和)
+        size_t position_base = 0;
+        size_t texcoord_base = 0;
+        size_t normal_base = 0;
+        size_t triangle_base = 0;
+    };
+
+    // 解析f行中一个 v, v/vt, v//vn 或 v/vt/vn, 失败返回nullptr
+    const char* parse_corner(const char* p, const char* end, Corner& corner)
+    {
+        corner.texcoord = corner.normal = 0;
+        std::from_chars_result result = std::from_chars(p, end, corner.position);
+        if (result.ec != std::errc() || corner.position == 0)
+            return nullptr;
+        p = result.ptr;
+        if (p < end && *p == '/') {
+            ++p;
+            if (p < end && *p != '/') {
+                result = std::from_chars(p, end, corner.texcoord);
+                if (result.ec != std::errc() || corner.texcoord == 0)
+                    return nullptr;
+                p = result.ptr;
+            }
+            if (p < end && *p == '/') {
+                ++p;
+                result = std::from_chars(p, end, corner.normal);
+                if (result.ec != std::errc() || corner.normal == 0)
+                    return nullptr;
+                p = result.ptr;
+            }
+        }
+        return p == end || is_blank(*p) ? p : nullptr;
+    }
+
+    inline bool token_is(const char* begin, const char* end, const char* token)
+    {
+        const size_t length = strlen(token);
+        return (size_t)(end - begin) == length && memcmp(begin, token, length) == 0;
+    }
+
+    // 第一遍: 只解析数值, 面的下标留到知道之前chunk的顶点个数后再解析
+    void parse_chunk(Chunk& chunk)
+    {
+        const char* p = chunk.begin;
+        const char* const end = chunk.end;
+        while (p < end) {
+            const char* line_end = static_cast<const char*>(memchr(p, '\n', end - p));
+            if (line_end == nullptr)
+                line_end = end;
+            const char* token = skip_blank(p, line_end);
+            const char* token_end = token;
+            while (token_end < line_end && !is_blank(*token_end))
+                ++token_end;
+            p = line_end + 1;
+            if (token == token_end || *token == '#')
+                continue;
+
+            const char* q = token_end;
+            if (token_is(token, token_end, "v")) {
+                glm::vec3 v;
+                if ((q = parse_float(q, line_end, v.x)) && (q = parse_float(q, line_end, v.y)) && (q = parse_float(q, line_end, v.z))) {
+                    chunk.positions.push_back(v);
+                } else {
+                    chunk.positions.emplace_back(0.0f);
+                    ++chunk.skipped;
+                }
+            } else if (token_is(token, token_end, "vt")) {
+                glm::vec2 t;
+                if ((q = parse_float(q, line_end, t.x)) && (q = parse_float(q, line_end, t.y))) {
+                    chunk.texcoords.push_back(t);
+                } else {
+                    chunk.texcoords.emplace_back(0.0f);
+                    ++chunk.skipped;
+                }
+            } else if (token_is(token, token_end, "vn")) {
+                glm::vec3 n;
+                if ((q = parse_float(q, line_end, n.x)) && (q = parse_float(q, line_end, n.y)) && (q = parse_float(q, line_end, n.z))) {
+                    chunk.normals.push_back(n);
+                } else {
+                    chunk.normals.emplace_back(0.0f);
+                    ++chunk.skipped;
+                }
+            } else if (token_is(token, token_end, "f")) {
+                const size_t first = chunk.corners.size();
+                bool valid = true;
+                while ((q = skip_blank(q, line_end)) < line_end) {
+                    Corner corner;
+                    q = parse_corner(q, line_end, corner);
+                    if (q == nullptr) {
+                        valid = false;
+                        break;
+                    }
+                    chunk.corners.push_back(corner);
+                }
+                if (!valid || chunk.corners.size() - first < 3) {
+                    chunk.corners.resize(first);
+                    ++chunk.skipped;
+                    continue;
+                }
+                chunk.faces.push_back({static_cast<uint32_t>(first), static_cast<uint32_t>(chunk.corners.size() - first),
+                                       static_cast<uint32_t>(chunk.positions.size()), static_cast<uint32_t>(chunk.texcoords.size()),
+                                       static_cast<uint32_t>(chunk.normals.size())});
+            } else if (token_is(token, token_end, "o") || token_is(token, token_end, "g")) {
+                chunk.events.push_back({chunk.faces.size(), 0, true});
+            } else if (token_is(token, token_end, "usemtl")) {
+                chunk.events.push_back({chunk.faces.size(), 0, false});
+            }
+        }
+    }
+
+    // 第二遍: 把下标解析为全局下标, 越界的面置为0个顶点, 统计三角形个数并确定mesh事件所在的三角形
+    void resolve_chunk(Chunk& chunk)
+    {
+        size_t event = 0;
+        for (size_t i = 0; i < chunk.faces.size(); ++i) {
+            Face& face = chunk.faces[i];
+            for (; event < chunk.events.size() && chunk.events[event].face == i; ++event)
+                chunk.events[event].triangle = chunk.triangles;
+            const size_t positions = chunk.position_base + face.positions;
+            const size_t texcoords = chunk.texcoord_base + face.texcoords;
+            const size_t normals = chunk.normal_base + face.normals;
+            bool valid = true;
+            for (uint32_t k = 0; k < face.count && valid; ++k) {
+                Corner& corner = chunk.corners[face.first + k];
+                uint32_t out = 0;
+                valid = resolve(corner.position, positions, out);
+                corner.position = static_cast<int32_t>(out);
+                // 没有纹理坐标/法线时记为-1
+                if (valid && corner.texcoord != 0) {
+                    valid = resolve(corner.texcoord, texcoords, out);
+                    corner.texcoord = static_cast<int32_t>(out);
+                } else {
+                    corner.texcoord = -1;
+                }
+                if (valid && corner.normal != 0) {
+                    valid = resolve(corner.normal, normals, out);
+                    corner.normal = static_cast<int32_t>(out);
+                } else {
+                    corner.normal = -1;
+                }
+            }
+            if (!valid) {
+                face.count = 0;
+                ++chunk.skipped;
+                continue;
+            }
+            ++chunk.valid_faces;
+            chunk.triangles += face.count - 2;
+        }
+        for (; event < chunk.events.size(); ++event)
+            chunk.events[event].triangle = chunk.triangles;
+    }
+
+    // 第三遍: 按扇形三角化, 位置下标写入indices (chunk的第一个三角形), normals/texcoords不为空时同时写入每个角的属性
+    void emit_chunk(const Chunk& chunk, const std::vector<glm::vec3>& positions, const std::vector<glm::vec2>& texcoords,
+                    const std::vector<glm::vec3>& normals, uint32_t* indices, glm::vec3* corner_normals, glm::vec2* corner_texcoords)
+    {
+        for (const Face& face : chunk.faces) {
+            if (face.count == 0)
+                continue;
+            const Corner* corners = chunk.corners.data() + face.first;
+            for (uint32_t k = 1; k + 1 < face.count; ++k) {
+                *indices++ = static_cast<uint32_t>(corners[0].position);
+                *indices++ = static_cast<uint32_t>(corners[k].position);
+                *indices++ = static_cast<uint32_t>(corners[k + 1].position);
+            }
+            if (corner_normals == nullptr)
+                continue;
+
+            // 任意一个顶点没有法线时整个面使用叉积法线 (与objl相同, 未归一化)
+            bool face_normal = false;
+            for (uint32_t k = 0; k < face.count; ++k)
+                face_normal |= corners[k].normal < 0;
+            glm::vec3 normal(0.0f);
+            if (face_normal) {
+                normal = glm::cross(positions[corners[0].position] - positions[corners[1].position],
+                                    positions[corners[2].position] - positions[corners[1].position]);
+            }
+            auto emit_corner = [&](const Corner& corner) {
+                *corner_normals++ = face_normal ? normal : normals[corner.normal];
+                *corner_texcoords++ = corner.texcoord >= 0 ? texcoords[corner.texcoord] : glm::vec2(0.0f);
+            };
+            for (uint32_t k = 1; k + 1 < face.count; ++k) {
+                emit_corner(corners[0]);
+                emit_corner(corners[k]);
+                emit_corner(corners[k + 1]);
+            }
+        }
+    }
+
+    template <typename T>
+    void gather(std::vector<Chunk>& chunks, std::vector<T> Chunk::*member, size_t Chunk::*base, std::vector<T>& all)
+    {
+        size_t total = 0;
+        for (Chunk& chunk : chunks) {
+            chunk.*base = total;
+            total += (chunk.*member).size();
+        }
+        all.resize(total);
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (long long c = 0; c < (long long)chunks.size(); ++c) {
+            const Chunk& chunk = chunks[c];
+            std::copy((chunk.*member).begin(), (chunk.*member).end(), all.begin() + chunk.*base);
+        }
+    }
+} // namespace
+
+bool read(const std::string& path, TriangleMesh& mesh, Stats& stats, bool attributes)
+{
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+    mesh.clear();
+    stats = Stats();
+    stats.bytes = file.size();
+
+    // 按字节数等分, 每个分界点后移到下一个换行之后
+    const char* const data = file.data();
+    const char* const end = data + file.size();
+    const size_t chunk_count = std::max<size_t>(1, std::min<size_t>(file.size() / minChunkSize, (size_t)omp_get_max_threads() * 4));
+    std::vector<Chunk> chunks(chunk_count);
+    const char* begin = data;
+    for (size_t c = 0; c < chunk_count; ++c) {
+        const char* split = c + 1 == chunk_count ? end : data + file.size() / chunk_count * (c + 1);
+        if (split < begin)
+            split = begin;
+        const char* newline = split < end ? static_cast<const char*>(memchr(split, '\n', end - split)) : nullptr;
+        split = newline ? newline + 1 : end;
+        chunks[c].begin = begin;
+        chunks[c].end = split;
+        begin = split;
+    }
+    stats.chunks = chunk_count;
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (long long c = 0; c < (long long)chunk_count; ++c)
+        parse_chunk(chunks[c]);
+
+    // v / vt / vn 个数的前缀和, 并合并到全局数组
+    std::vector<glm::vec3>& positions = mesh.positions;
+    std::vector<glm::vec2> texcoords;
+    std::vector<glm::vec3> normals;
+    gather(chunks, &Chunk::positions, &Chunk::position_base, positions);
+    gather(chunks, &Chunk::texcoords, &Chunk::texcoord_base, texcoords);
+    gather(chunks, &Chunk::normals, &Chunk::normal_base, normals);
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (long long c = 0; c < (long long)chunk_count; ++c)
+        resolve_chunk(chunks[c]);
+
+    // 三角形个数的前缀和; 对象的划分规则与objl::Loader的mesh相同, 按事件顺序确定
+    std::vector<size_t>& object_begin = mesh.objectBegin;
+    size_t triangles = 0;
+    object_begin.assign(1, 0);
+    bool seen_group = false;
+    for (Chunk& chunk : chunks) {
+        chunk.triangle_base = triangles;
+        for (const MeshEvent& event : chunk.events) {
+            const size_t current = chunk.triangle_base + event.triangle;
+            if (event.group && !seen_group) {
+                seen_group = true;
+            } else if (current > object_begin.back()) {
+                object_begin.push_back(current);
+            }
+        }
+        triangles += chunk.triangles;
+        stats.faces += chunk.valid_faces;
+        stats.skipped += chunk.skipped;
+    }
+    // 最后一个对象没有三角形时不计
+    if (object_begin.size() > 1 && object_begin.back() == triangles)
+        object_begin.pop_back();
+
+    mesh.indices.resize(triangles * 3);
+    if (attributes) {
+        mesh.normals.resize(triangles * 3);
+        mesh.texcoords.resize(triangles * 3);
+    }
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (long long c = 0; c < (long long)chunk_count; ++c) {
+        const size_t first = chunks[c].triangle_base * 3;
+        emit_chunk(chunks[c], positions, texcoords, normals, mesh.indices.data() + first,
+                   attributes ? mesh.normals.data() + first : nullptr, attributes ? mesh.texcoords.data() + first : nullptr);
+    }
+
+    stats.positions = positions.size();
+    stats.texcoords = texcoords.size();
+    stats.normals = normals.size();
+    return true;
+}
+
+} // namespace obj
@@ -0,0 +1,58 @@
+#ifndef OBJ_READER_H_
+#define OBJ_READER_H_
+
+#include "triangle_mesh.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 基于内存映射的OBJ读取, 代替objl::Loader (逐行getline并为每行构造临时字符串)
+// 数值用std::from_chars直接在映射的缓冲区上解析, 三角形的位置下标直接写入索引网格
+// 文件按换行对齐切分为多个chunk并行解析, 各chunk顶点个数的前缀和用于解析面的 (包括负数的) 下标
+namespace obj {
+    // 只读映射整个文件, 析构时解除映射
+    class MappedFile {
+    public:
+        MappedFile() = default;
+        ~MappedFile() { close(); }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool open(const std::string& path);
+        void close();
+
+        const char* data() const { return m_data; }
+        size_t size() const { return m_size; }
+
+    private:
+        const char* m_data = nullptr;
+        size_t m_size = 0;
+#ifdef _WIN32
+        void* m_file = nullptr;
+        void* m_mapping = nullptr;
+#endif
+    };
+
+    struct Stats {
+        size_t bytes = 0;
+        size_t positions = 0;
+        size_t texcoords = 0;
+        size_t normals = 0;
+        size_t faces = 0;
+        // 并行解析的chunk数
+        size_t chunks = 0;
+        // 索引越界或格式错误而跳过的行
+        size_t skipped = 0;
+    };
+
+    // 解析path中的 v / vt / vn / f, 多边形按扇形三角化, 结果写入mesh (位置为文件中的全部v)
+    // attributes为true时同时输出每个角的法线与纹理坐标; 面没有法线时与objl相同, 以前三个顶点的叉积作为整个面的法线
+    // 对象的划分 (mesh.objectBegin) 规则与objl::Loader的mesh相同:
+    // 当前mesh已有三角形时, 遇到o/g (第一次出现的除外) 或usemtl开始新的mesh
+    bool read(const std::string& path, TriangleMesh& mesh, Stats& stats, bool attributes);
+} // namespace obj
+
+#endif // OBJ_READER_H_
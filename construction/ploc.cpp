@@ -0,0 +1,199 @@
+#include "ploc.hpp"
+#include "lbvh.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <omp.h>
+
+// 未指定--max_leaf时叶子的图元数上限
+#define defaultMaxLeaf 4
+// 压缩时每块的cluster数
+#define compactBlockSize 4096
+
+namespace {
+    long long elapsed_us(std::chrono::high_resolution_clock::time_point start)
+    {
+        auto now = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration_cast<std::chrono::microseconds>(now - start).count();
+    }
+
+    // 合并后包围盒面积的一半, 对a, b对称
+    inline float merged_area(const BoundingBox& a, const BoundingBox& b)
+    {
+        const float dx = std::max(a.max.x, b.max.x) - std::min(a.min.x, b.min.x);
+        const float dy = std::max(a.max.y, b.max.y) - std::min(a.min.y, b.min.y);
+        const float dz = std::max(a.max.z, b.max.z) - std::min(a.min.z, b.min.z);
+        return dx * dy + dy * dz + dz * dx;
+    }
+} // namespace
+
+PLOC::PLOC(size_t radius, int morton_bits, size_t max_leaf, LinearBVH::Layout layout)
+    : m_radius(std::max<size_t>(radius, 1))
+    , m_mortonBits(morton_bits)
+    , m_maxLeaf(max_leaf > 0 ? max_leaf : defaultMaxLeaf)
+    , m_layout(layout)
+{
+}
+
+void PLOC::collectSlots(const KBVHNode* node, std::vector<size_t>& slots)
+{
+    std::vector<const KBVHNode*> stack(1, node);
+    while (!stack.empty()) {
+        const KBVHNode* current = stack.back();
+        stack.pop_back();
+        if (current->isLeaf()) {
+            for (size_t slot = current->begin; slot < current->end; ++slot)
+                slots.push_back(slot);
+        } else {
+            stack.push_back(current->r);
+            stack.push_back(current->l);
+        }
+    }
+}
+
+size_t PLOC::layoutLeaves(KBVHNode* node, size_t next, const PrimitiveBounds& source, PrimitiveBounds& target) const
+{
+    // 显式栈: 聚类得到的树可能很深
+    std::vector<KBVHNode*> stack(1, node);
+    std::vector<size_t> slots;
+    while (!stack.empty()) {
+        KBVHNode* current = stack.back();
+        stack.pop_back();
+        if (!current->isLeaf() && current->count > m_maxLeaf) {
+            stack.push_back(current->r);
+            stack.push_back(current->l);
+            continue;
+        }
+        slots.clear();
+        collectSlots(current, slots);
+        for (size_t i = 0; i < slots.size(); ++i)
+            target.copy(next + i, source, slots[i]);
+        current->begin = next;
+        current->end = next + slots.size();
+        current->l = current->r = NULL;
+        next = current->end;
+    }
+    return next;
+}
+
+void PLOC::build(const TriangleMesh& mesh, PrimitiveBounds& bounds, Arena& arena, LinearBVH& bvh)
+{
+    (void)mesh;
+    bvh.nodes.clear();
+    const size_t n = bounds.size();
+    if (n == 0)
+        return;
+
+    std::cout << "[Log] PLOC Building... (radius " << m_radius << ", " << m_mortonBits << "-bit Morton codes, max leaf "
+              << m_maxLeaf << ", " << omp_get_max_threads() << " threads)" << std::endl;
+    LBVH::sortByMorton(bounds, m_mortonBits);
+
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    // 初始cluster: 每个槽位一个叶子, 按Morton序排列
+    KBVHNode* leaves = arena.allocate<KBVHNode>(n);
+    std::vector<KBVHNode*> clusters(n), compacted(n);
+    #pragma omp parallel for schedule(static)
+    for (long long i = 0; i < (long long)n; ++i) {
+        KBVHNode* leaf = new (leaves + i) KBVHNode(bounds.get_bbox(i), 1);
+        leaf->begin = i;
+        leaf->end = i + 1;
+        clusters[i] = leaf;
+    }
+
+    std::vector<uint32_t> nearest(n);
+    std::vector<BoundingBox> boxes(n);
+    std::vector<uint32_t> tag(n);
+    std::vector<size_t> block_offset;
+    size_t count = n;
+    size_t iterations = 0;
+    const long long radius = static_cast<long long>(m_radius);
+    while (count > 1) {
+        ++iterations;
+
+        // 当前cluster的包围盒连续存放, 窗口内的访问不必经过分散在arena中的节点
+        // tag: 每个位置的20位散列, 一对的散列取两侧tag的异或 (对称)
+        #pragma omp parallel for schedule(static)
+        for (long long i = 0; i < (long long)count; ++i) {
+            boxes[i] = clusters[i]->bb;
+            tag[i] = static_cast<uint32_t>(((uint64_t)i * 0x9E3779B97F4A7C15ull) >> 44);
+        }
+
+        // 最近邻: 每一对按 (面积, 散列) 比较, 完全相同时取下标小的邻居, 编码为一个64位整数:
+        //   [非负float面积的位模式 (与大小同序) 32位][散列 20位][j - first 12位]
+        // 全局最小的键中下标最小的cluster与它选中的邻居互为最近邻, 每轮至少合并一对.
+        // 面积相同 (中心重合, 或一侧包含另一侧) 很常见, 若只按下标取最小, 一整段只有最左的一对互为最近邻,
+        // 轮数退化为O(n); 散列使相同面积的各对近似随机地排序. 用整数min而不是分支比较, 避免分支预测失败
+        #pragma omp parallel for schedule(static)
+        for (long long i = 0; i < (long long)count; ++i) {
+            const long long first = std::max(i - radius, 0LL);
+            const long long last = std::min(i + radius, (long long)count - 1);
+            uint64_t best_key = UINT64_MAX;
+            for (long long j = first; j <= last; ++j) {
+                if (j == i)
+                    continue;
+                const float area = merged_area(boxes[i], boxes[j]);
+                uint32_t area_bits;
+                memcpy(&area_bits, &area, sizeof(area_bits));
+                const uint64_t key = ((uint64_t)area_bits << 32) | ((uint64_t)(tag[i] ^ tag[j]) << 12) | (uint64_t)(j - first);
+                best_key = std::min(best_key, key);
+            }
+            const long long best_j = best_key == UINT64_MAX ? i : first + (long long)(best_key & 0xfff);
+            nearest[i] = static_cast<uint32_t>(best_j);
+        }
+
+        // 合并: 互为最近邻的一对由下标小的一侧处理, 结果放在它的位置, 另一侧置空
+        #pragma omp parallel for schedule(static)
+        for (long long i = 0; i < (long long)count; ++i) {
+            const size_t j = nearest[i];
+            if ((size_t)i >= j || nearest[j] != (size_t)i)
+                continue;
+            BoundingBox bb = clusters[i]->bb;
+            bb.expand(clusters[j]->bb);
+            KBVHNode* node = arena.create<KBVHNode>(bb, clusters[i]->count + clusters[j]->count);
+            node->l = clusters[i];
+            node->r = clusters[j];
+            clusters[i] = node;
+            clusters[j] = NULL;
+        }
+
+        // 压缩: 每块统计保留的cluster数, 求前缀和后并行写入
+        const size_t blocks = (count + compactBlockSize - 1) / compactBlockSize;
+        block_offset.assign(blocks + 1, 0);
+        #pragma omp parallel for schedule(static)
+        for (long long b = 0; b < (long long)blocks; ++b) {
+            const size_t end = std::min<size_t>(count, (b + 1) * (size_t)compactBlockSize);
+            size_t kept = 0;
+            for (size_t i = b * (size_t)compactBlockSize; i < end; ++i)
+                kept += clusters[i] != NULL;
+            block_offset[b + 1] = kept;
+        }
+        for (size_t b = 0; b < blocks; ++b)
+            block_offset[b + 1] += block_offset[b];
+        #pragma omp parallel for schedule(static)
+        for (long long b = 0; b < (long long)blocks; ++b) {
+            const size_t end = std::min<size_t>(count, (b + 1) * (size_t)compactBlockSize);
+            size_t out = block_offset[b];
+            for (size_t i = b * (size_t)compactBlockSize; i < end; ++i) {
+                if (clusters[i] != NULL)
+                    compacted[out++] = clusters[i];
+            }
+        }
+        count = block_offset[blocks];
+        clusters.swap(compacted);
+    }
+    KBVHNode* root = clusters[0];
+    std::cout << "[Log] PLOC clustering: " << iterations << " iterations, " << elapsed_us(start_time) << " us" << std::endl;
+
+    // 叶子区间: 按树的DFS顺序重排槽位
+    start_time = std::chrono::high_resolution_clock::now();
+    PrimitiveBounds sorted;
+    sorted.resize(n);
+    layoutLeaves(root, 0, bounds, sorted);
+    bounds = std::move(sorted);
+    std::cout << "[Log] PLOC leaf layout: " << elapsed_us(start_time) << " us" << std::endl;
+
+    bvh.flatten(root, m_layout);
+}
@@ -0,0 +1,37 @@
+#ifndef PLOC_H_
+#define PLOC_H_
+
+#include "build_engine.hpp"
+#include "kmeans.hpp"
+
+#include <cstddef>
+#include <vector>
+
+// PLOC (Meister & Bittner 2018): 自底向上的并行局部有序聚类
+// 从Morton序的单图元cluster出发, 每轮:
+//   1. 每个cluster在前后radius个cluster中找合并后面积最小的邻居
+//   2. 互为最近邻的一对合并为一个节点 (下标小的一侧保存)
+//   3. 压缩掉被合并的cluster, 保持Morton序
+// 直到只剩一个cluster. 合并的cluster在槽位上不一定相邻, 最后按树的叶子顺序重排槽位
+class PLOC : public BuildEngine {
+public:
+    // max_leaf为0时使用默认的叶子图元数上限
+    PLOC(size_t radius, int morton_bits, size_t max_leaf, LinearBVH::Layout layout);
+
+    const char* name() const override { return "PLOC"; }
+
+    void build(const TriangleMesh& mesh, PrimitiveBounds& bounds, Arena& arena, LinearBVH& bvh) override;
+
+private:
+    // 把node的子树按DFS顺序复制到target的槽位[next, ...), 图元数不超过max_leaf的子树成为一个叶子
+    size_t layoutLeaves(KBVHNode* node, size_t next, const PrimitiveBounds& source, PrimitiveBounds& target) const;
+    // 收集子树中所有图元的原槽位 (叶子的begin)
+    static void collectSlots(const KBVHNode* node, std::vector<size_t>& slots);
+
+    size_t m_radius;
+    int m_mortonBits;
+    size_t m_maxLeaf;
+    LinearBVH::Layout m_layout;
+};
+
+#endif // PLOC_H_
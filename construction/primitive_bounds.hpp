@@ -0,0 +1,77 @@
+#ifndef PRIMITIVE_BOUNDS_H_
+#define PRIMITIVE_BOUNDS_H_
+
+#include "aligned_allocator.hpp"
+#include "bbox.hpp"
+#include "triangle_mesh.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// 所有图元预先计算好的包围盒 (SoA布局, 64字节对齐)
+// 在BVHBuilder::Build()中构造一次, 所有Kmeans节点共享, 每个图元只占 6 * 4 = 24 字节
+// 每个Kmeans节点拥有一段连续的槽位[begin, end), 聚类后在区间内原地重排,
+// 子节点的区间互不相交, 因此可以被并行的子树同时修改
+class PrimitiveBounds {
+public:
+    aligned_vector<float> minX, minY, minZ;
+    aligned_vector<float> maxX, maxY, maxZ;
+    // 槽位 -> 原始图元下标 (全局重排数组)
+    aligned_vector<uint32_t> index;
+    // 槽位所属cluster, 只在节点重排时作为临时数据使用
+    aligned_vector<uint8_t> label;
+
+    void resize(size_t n)
+    {
+        minX.resize(n); minY.resize(n); minZ.resize(n);
+        maxX.resize(n); maxY.resize(n); maxZ.resize(n);
+        index.resize(n);
+        label.resize(n);
+    }
+
+    void build(const TriangleMesh& mesh)
+    {
+        const size_t n = mesh.size();
+        resize(n);
+
+        #pragma omp parallel for schedule(static)
+        for (long long i = 0; i < (long long)n; ++i) {
+            const glm::vec3& a = mesh.vertex(i, 0);
+            const glm::vec3& b = mesh.vertex(i, 1);
+            const glm::vec3& c = mesh.vertex(i, 2);
+            minX[i] = std::min(a.x, std::min(b.x, c.x));
+            minY[i] = std::min(a.y, std::min(b.y, c.y));
+            minZ[i] = std::min(a.z, std::min(b.z, c.z));
+            maxX[i] = std::max(a.x, std::max(b.x, c.x));
+            maxY[i] = std::max(a.y, std::max(b.y, c.y));
+            maxZ[i] = std::max(a.z, std::max(b.z, c.z));
+            index[i] = static_cast<uint32_t>(i);
+        }
+    }
+
+    // 把src的槽位src_slot复制到本存储的槽位dst
+    void copy(size_t dst, const PrimitiveBounds& src, size_t src_slot)
+    {
+        minX[dst] = src.minX[src_slot]; minY[dst] = src.minY[src_slot]; minZ[dst] = src.minZ[src_slot];
+        maxX[dst] = src.maxX[src_slot]; maxY[dst] = src.maxY[src_slot]; maxZ[dst] = src.maxZ[src_slot];
+        index[dst] = src.index[src_slot];
+    }
+
+    // 交换两个槽位的全部数据
+    void swap(size_t a, size_t b)
+    {
+        std::swap(minX[a], minX[b]); std::swap(minY[a], minY[b]); std::swap(minZ[a], minZ[b]);
+        std::swap(maxX[a], maxX[b]); std::swap(maxY[a], maxY[b]); std::swap(maxZ[a], maxZ[b]);
+        std::swap(index[a], index[b]);
+        std::swap(label[a], label[b]);
+    }
+
+    size_t size() const { return minX.size(); }
+
+    glm::vec3 min(size_t i) const { return glm::vec3(minX[i], minY[i], minZ[i]); }
+    glm::vec3 max(size_t i) const { return glm::vec3(maxX[i], maxY[i], maxZ[i]); }
+
+    BoundingBox get_bbox(size_t i) const { return BoundingBox(min(i), max(i)); }
+};
+#endif // PRIMITIVE_BOUNDS_H_
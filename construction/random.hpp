@@ -0,0 +1,51 @@
+#ifndef RANDOM_H_
+#define RANDOM_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// 基于计数器的随机数 (splitmix64): 第n个随机数只由(seed, key, n)决定,
+// 每个Kmeans节点以自己在树中的路径作为key, 因此结果与线程数和构造顺序无关
+class CounterRng {
+public:
+    CounterRng(uint64_t seed, uint64_t key)
+        : m_key(mix(seed ^ mix(key)))
+        , m_counter(0)
+    {
+    }
+
+    uint64_t next()
+    {
+        return mix(m_key + 0x9E3779B97F4A7C15ull * (++m_counter));
+    }
+
+    // [0, n) 内的均匀整数
+    size_t uniform(size_t n)
+    {
+        return static_cast<size_t>(next() % n);
+    }
+
+    // [0, 1) 内的均匀实数
+    double uniform_real()
+    {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    // 子节点路径: 由父节点路径和子节点序号决定
+    static uint64_t child_key(uint64_t parent, uint64_t child)
+    {
+        return mix(parent * 0x100000001B3ull + child + 1);
+    }
+
+    static uint64_t mix(uint64_t z)
+    {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+private:
+    uint64_t m_key;
+    uint64_t m_counter;
+};
+#endif // RANDOM_H_
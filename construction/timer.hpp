@@ -3,6 +3,7 @@
 #include <sstream>
 #include <vector>
 #include <string>
+#include <mutex>
 #include <stdexcept>
 
 namespace timer {
@@ -40,7 +41,7 @@ namespace timer {
         std::ios_base::openmode mode = file_exists_and_not_empty ? std::ios::trunc : std::ios::app;
         std::ofstream csv_file("oncetime/oncetime.csv", mode);
 
-        const std::vector<std::string> header = {"Kmeans ID", "Depth", "Construction(us)"};
+        const std::vector<std::string> header = {"Kmeans ID", "Depth", "Construction(us)", "Iterations"};
         const std::string header_line = csv::join(header, ',');
         if (csv_file.is_open()) {
             csv_file << header_line << "\n";
@@ -49,10 +50,13 @@ namespace timer {
             std::cerr << "ERROR::Failed to open CSV file for writing!!!" << std::endl;
         }
     }
-    inline void write_k_means_time(int id, int depth, long long time) {
+    inline void write_k_means_time(int id, int depth, long long time, size_t iterations) {
+        // 任务并行构造时多个节点会同时写入
+        static std::mutex csv_mutex;
+        std::lock_guard<std::mutex> lock(csv_mutex);
         // 将耗时写入CSV文件
         std::ofstream csv_file("oncetime/oncetime.csv", std::ios::app);
-        const std::vector<std::string> row = {std::to_string(id), std::to_string(depth), std::to_string(time)};
+        const std::vector<std::string> row = {std::to_string(id), std::to_string(depth), std::to_string(time), std::to_string(iterations)};
         const std::string row_content = csv::join(row, ',');
         if (csv_file.is_open()) {
             csv_file << row_content << std::endl;
@@ -0,0 +1,88 @@
+#ifndef TRIANGLE_MESH_H_
+#define TRIANGLE_MESH_H_
+
+#include "bbox.hpp"
+#include "primitive.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 索引三角形网格: 共享的顶点位置 + 每个三角形3个32位位置下标
+// 构造只读取positions与indices, 每个三角形12字节加上共享的位置 (Primitive为3个完整的Vertex, 136字节)
+// 法线与纹理坐标是可选的属性流, 按三角形的角存放 (OBJ中v / vt / vn各自编号, 不能共用位置下标), 构造不读取
+// 三角形按对象 (OBJ中的o / g / usemtl分组) 连续存放, objects为每个三角形的对象编号
+class TriangleMesh {
+public:
+    std::vector<glm::vec3> positions;
+    // 第t个三角形为 positions[indices[3t]], positions[indices[3t + 1]], positions[indices[3t + 2]]
+    std::vector<uint32_t> indices;
+    // 可选属性: 为空, 或每个三角形3项 (与indices一一对应)
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> texcoords;
+    // 每个对象第一个三角形的下标, 至少有一个对象
+    std::vector<size_t> objectBegin;
+    // 每个三角形所属的对象, 由assignObjects()按objectBegin填写
+    std::vector<uint32_t> objects;
+
+    size_t size() const { return indices.size() / 3; }
+    size_t objectCount() const { return objectBegin.size(); }
+    // 第o个对象的三角形数
+    size_t objectSize(size_t o) const { return (o + 1 < objectBegin.size() ? objectBegin[o + 1] : size()) - objectBegin[o]; }
+    bool empty() const { return indices.empty(); }
+    bool hasAttributes() const { return !normals.empty(); }
+
+    const glm::vec3& vertex(size_t triangle, int corner) const { return positions[indices[triangle * 3 + corner]]; }
+
+    BoundingBox bbox(size_t triangle) const
+    {
+        BoundingBox bb(vertex(triangle, 0));
+        bb.expand(vertex(triangle, 1));
+        bb.expand(vertex(triangle, 2));
+        return bb;
+    }
+
+    // 组装完整的三角形, 没有属性流时法线与纹理坐标为0
+    Primitive primitive(size_t triangle) const
+    {
+        const size_t first = triangle * 3;
+        const bool attributes = hasAttributes();
+        auto corner = [&](int k) {
+            return Vertex(positions[indices[first + k]], attributes ? normals[first + k] : glm::vec3(0.0f),
+                          attributes ? texcoords[first + k] : glm::vec2(0.0f));
+        };
+        return Primitive(corner(0), corner(1), corner(2));
+    }
+
+    // 按objectBegin填写每个三角形的对象编号, 各对象并行
+    void assignObjects()
+    {
+        objects.resize(size());
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (long long o = 0; o < (long long)objectBegin.size(); ++o) {
+            const size_t begin = objectBegin[o];
+            std::fill(objects.begin() + begin, objects.begin() + begin + objectSize(o), static_cast<uint32_t>(o));
+        }
+    }
+
+    void clear()
+    {
+        positions.clear();
+        indices.clear();
+        normals.clear();
+        texcoords.clear();
+        objectBegin.clear();
+        objects.clear();
+    }
+
+    // 构造路径上的字节数 (位置与下标)
+    size_t geometryBytes() const { return positions.size() * sizeof(glm::vec3) + indices.size() * sizeof(uint32_t); }
+    // 属性流与对象编号的字节数
+    size_t attributeBytes() const
+    {
+        return normals.size() * sizeof(glm::vec3) + texcoords.size() * sizeof(glm::vec2) + objects.size() * sizeof(uint32_t);
+    }
+};
+
+#endif // TRIANGLE_MESH_H_
@@ -2,6 +2,7 @@
 #include "renderengine/utils/IOUtils.h"
 #include "visualization/BVHVisualizationRenderLogic.h"
 #include "construction/timer.hpp"
+#include "construction/build_options.hpp"
 #include <omp.h>
 
 int main(int argc, char *argv[]) {
@@ -20,6 +21,9 @@ int main(int argc, char *argv[]) {
             std::cout << "[WARNING] program without rendering" << std::endl;
             continue;
         }
+        if (BuildOptions::global().parse(argc, argv, i)) {
+            continue;
+        }
         filtered_args.push_back(arg);
     }
 
@@ -23,5 +23,11 @@ if ($args.Count -ge 1) {
     }
 }
 
+# Extra args after the model are forwarded as build options
+$EXTRA = @()
+if ($args.Count -gt 1) {
+    $EXTRA = $args[1..($args.Count - 1)]
+}
+
 # Run the visualization
-./BVHVisualization.exe --no_gui $MODEL
\ No newline at end of file
+./BVHVisualization.exe --no_gui $MODEL @EXTRA
\ No newline at end of file
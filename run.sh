@@ -24,5 +24,6 @@ if [ $# -ge 1 ]; then
 fi
 
 
-./BVHVisualization --no_gui --no_render "$MODEL"
+# extra args after the model are forwarded as build options
+./BVHVisualization --no_gui --no_render "$MODEL" "${@:2}"
 
@@ -1,4 +1,5 @@
 import os
+import sys
 import platform
 import shutil
 import csv
@@ -21,6 +22,8 @@ def get_last_valid_value(csv_file):
 def main():
     runs = 100
     models = ["Cow", "Dragon", "Face", "Car"]
+    # build options forwarded to every run, e.g. `python runt.py --task_parallel --compare`
+    extra_args = " ".join(sys.argv[1:])
 
     runtime_csv = "runtime.csv"
     onetime_csv = "oncetime/oncetime.csv"
@@ -34,9 +37,9 @@ def main():
     for model in models:
         for i in range(1, runs + 1):
             if platform.system() == 'Windows':
-                os.system(f"powershell -ExecutionPolicy Bypass -File run.ps1 {model}")
+                os.system(f"powershell -ExecutionPolicy Bypass -File run.ps1 {model} {extra_args}")
             else:
-                os.system(f"./run.sh {model}")
+                os.system(f"./run.sh {model} {extra_args}")
 
             target_dir = os.path.join(statistics_dir, model, f"{i:03d}")
             ensure_directory_exists(target_dir)